@@ -0,0 +1,251 @@
+/*
+ * BlobLabeler.cpp
+ *
+ *	Source file containing a single pass, run based connected component labeler that measures each blob while it scans.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "BlobLabeler.h"
+#include <algorithm>
+
+using namespace cv;
+
+// ================================= Variables ================================= //
+
+// Fewest rows given to each strip by the parallel labeler, so joining strips stays cheap next to labeling them
+int const min_strip_rows = 16;
+
+// ================================= End Variables ================================= //
+
+/*
+ * Loop body used to label strips of rows on every core at once
+ */
+class StripBody : public ParallelLoopBody
+{
+public:
+	StripBody( BlobLabeler *labeler, const Mat &mask ) : labeler( labeler ), mask( mask ) { }
+
+	void operator()( const Range &range ) const
+	{
+		for ( int i = range.start; i < range.end; i++ )
+			labeler->labelStrip( mask, i );
+	}
+
+private:
+	BlobLabeler *labeler;
+	const Mat &mask;
+};
+
+// ===================================================
+// 				BLOB LABELER CLASS
+// ===================================================
+
+BlobLabeler::BlobLabeler() { }
+
+BlobLabeler::~BlobLabeler() { }
+
+// ============= Functions
+/*
+ * Finds every blob of non zero pixels in 'mask' and adds those with an area greater than 'minArea' and no more than 'maxArea' to
+ * 'blobs'. The mask is only read, never changed. Returns the number of blobs found of any size.
+ */
+int BlobLabeler::label( const Mat &mask, int minArea, int maxArea, std::vector<Blob> *blobs )
+{
+	CV_Assert( mask.type() == CV_8UC1 );
+
+	strips.resize( 1 );
+	strips[0].rowBegin = 0;
+	strips[0].rowEnd = mask.rows;
+
+	if ( mask.rows == 0 )
+		return 0;
+
+	labelStrip( mask, 0 );
+
+	return collect( strips[0].parent, strips[0].totals, minArea, maxArea, blobs );
+}
+
+/*
+ * The same as label, but the rows are split into strips that are labeled on every core at once. Blobs that cross from one strip to
+ * the next are then joined using the last row of one strip and the first row of the next, so the blobs found are exactly the same.
+ * If 'stripCount' is not given, there is one strip for each thread OpenCV uses.
+ */
+int BlobLabeler::labelParallel( const Mat &mask, int minArea, int maxArea, std::vector<Blob> *blobs, int stripCount )
+{
+	CV_Assert( mask.type() == CV_8UC1 );
+
+	if ( stripCount <= 0 ) stripCount = getNumThreads();
+	stripCount = std::max( 1, std::min( stripCount, mask.rows / min_strip_rows ) );
+
+	if ( stripCount == 1 )
+		return label( mask, minArea, maxArea, blobs );
+
+	strips.resize( stripCount );
+	for ( int s = 0; s < stripCount; s++ )
+	{
+		strips[s].rowBegin = mask.rows * s / stripCount;
+		strips[s].rowEnd = mask.rows * (s + 1) / stripCount;
+	}
+
+	parallel_for_( Range( 0, stripCount ), StripBody( this, mask ) );
+
+	// Put every strip's forest into one, moving each strip's run indices past those of the strips before it
+	offsets.assign( stripCount, 0 );
+	parent.clear();
+	totals.clear();
+
+	for ( int s = 0; s < stripCount; s++ )
+	{
+		offsets[s] = parent.size();
+
+		for ( size_t i = 0; i < strips[s].parent.size(); i++ )
+			parent.push_back( strips[s].parent[i] + offsets[s] );
+
+		totals.insert( totals.end(), strips[s].totals.begin(), strips[s].totals.end() );
+	}
+
+	// Join blobs that cross each boundary between strips
+	for ( int s = 1; s < stripCount; s++ )
+	{
+		const Strip &upper = strips[s - 1], &lower = strips[s];
+
+		joinTouching( upper.runs, upper.lastRowBegin, upper.runs.size(), offsets[s - 1],
+		              lower.runs, 0, lower.firstRowEnd, offsets[s], parent, totals );
+	}
+
+	return collect( parent, totals, minArea, maxArea, blobs );
+}
+
+/*
+ * Labels the rows of strip 's' of 'mask', building its runs, its union-find forest and the totals of each blob.
+ */
+void BlobLabeler::labelStrip( const Mat &mask, int s )
+{
+	Strip &strip = strips[s];
+	size_t previousBegin = 0, previousEnd = 0;
+
+	strip.runs.clear();
+	strip.parent.clear();
+	strip.totals.clear();
+	strip.firstRowEnd = 0;
+
+	for ( int y = strip.rowBegin; y < strip.rowEnd; y++ )
+	{
+		const uchar *p = mask.ptr<uchar>(y);
+		size_t rowBegin = strip.runs.size();
+		int x = 0;
+
+		while ( x < mask.cols )
+		{
+			// Skip to the start of the next run, then to its end
+			while ( x < mask.cols && p[x] == 0 ) x++;
+			if ( x == mask.cols ) break;
+
+			int start = x;
+			while ( x < mask.cols && p[x] != 0 ) x++;
+
+			Run run = { y, start, x };
+			Blob total;
+			total.area = x - start;
+			total.m10 = ( start + x - 1 ) * (double)( x - start ) / 2;
+			total.m01 = (double)y * ( x - start );
+			total.box = Rect( start, y, x - start, 1 );
+
+			strip.parent.push_back( strip.runs.size() );
+			strip.runs.push_back( run );
+			strip.totals.push_back( total );
+		}
+
+		joinTouching( strip.runs, previousBegin, previousEnd, 0, strip.runs, rowBegin, strip.runs.size(), 0, strip.parent, strip.totals );
+
+		if ( y == strip.rowBegin ) strip.firstRowEnd = strip.runs.size();
+		previousBegin = rowBegin;
+		previousEnd = strip.runs.size();
+	}
+
+	strip.lastRowBegin = previousBegin;
+}
+
+/*
+ * Returns the root of the tree 'i' belongs to, halving the path to it on the way
+ */
+int BlobLabeler::find( std::vector<int> &parent, int i )
+{
+	while ( parent[i] != i )
+	{
+		parent[i] = parent[ parent[i] ];
+		i = parent[i];
+	}
+
+	return i;
+}
+
+/*
+ * Joins the trees of 'a' and 'b', adding up their totals at the new root. The lower index becomes the root.
+ */
+void BlobLabeler::join( std::vector<int> &parent, std::vector<Blob> &totals, int a, int b )
+{
+	int rootA = find( parent, a ), rootB = find( parent, b );
+
+	if ( rootA == rootB )
+		return;
+
+	if ( rootB < rootA ) std::swap( rootA, rootB );
+
+	Blob &into = totals[rootA];
+	const Blob &from = totals[rootB];
+
+	into.area += from.area;
+	into.m10 += from.m10;
+	into.m01 += from.m01;
+	into.box |= from.box;
+
+	parent[rootB] = rootA;
+}
+
+/*
+ * Joins every run in 'upper' [upperBegin, upperEnd) with every run in 'lower' [lowerBegin, lowerEnd) that it touches, including
+ * diagonally. The runs of each row are in order, so both lists are walked once. The offsets turn run indices into forest indices.
+ */
+void BlobLabeler::joinTouching( const std::vector<Run> &upper, size_t upperBegin, size_t upperEnd, int upperOffset,
+                                const std::vector<Run> &lower, size_t lowerBegin, size_t lowerEnd, int lowerOffset,
+                                std::vector<int> &parent, std::vector<Blob> &totals )
+{
+	size_t i = upperBegin, j = lowerBegin;
+
+	while ( i < upperEnd && j < lowerEnd )
+	{
+		const Run &u = upper[i], &l = lower[j];
+
+		if ( u.start <= l.end && l.start <= u.end )
+			join( parent, totals, i + upperOffset, j + lowerOffset );
+
+		// Move past whichever run finishes first; the other may still touch the next run
+		if ( u.end < l.end ) i++;
+		else j++;
+	}
+}
+
+/*
+ * Adds the totals of every tree whose area is greater than 'minArea' and no more than 'maxArea' to 'blobs'. Returns the number of
+ * trees of any size.
+ */
+int BlobLabeler::collect( std::vector<int> &parent, std::vector<Blob> &totals, int minArea, int maxArea, std::vector<Blob> *blobs )
+{
+	int count = 0;
+
+	for ( size_t i = 0; i < parent.size(); i++ )
+	{
+		if ( parent[i] != (int)i )
+			continue;
+
+		count++;
+
+		if ( totals[i].area > minArea && totals[i].area <= maxArea )
+			blobs->push_back( totals[i] );
+	}
+
+	return count;
+}
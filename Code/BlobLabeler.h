@@ -0,0 +1,74 @@
+/*
+ * BlobLabeler.h
+ *
+ * Header file for a connected component labeler that finds the blobs of set pixels in a binary image in a single pass. Each row is
+ * split into runs of set pixels, runs that touch runs in the row above are joined with union-find, and the area, first moments and
+ * bounding box of each blob are added up as the runs are found. A parallel version labels strips of rows at once and joins them
+ * afterwards.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <opencv/cv.h>
+#include <vector>
+
+#ifndef BLOBLABELER_H_
+#define BLOBLABELER_H_
+
+/*
+ * A group of 8-connected set pixels
+ */
+typedef struct Blob
+{
+	int area; // Number of pixels
+	double m10, m01; // Sums of the x and y coordinates of the pixels
+	cv::Rect box;
+} Blob;
+
+class BlobLabeler {
+public:
+	// Constructors
+	BlobLabeler();
+	~BlobLabeler();
+
+	// Functions
+	int label( const cv::Mat&, int, int, std::vector<Blob>* );
+	int labelParallel( const cv::Mat&, int, int, std::vector<Blob>*, int strips = 0 );
+
+private:
+	// The parallel loop body labels one strip at a time
+	friend class StripBody;
+	// A run of set pixels in one row, from 'start' up to but not including 'end'
+	struct Run
+	{
+		int row, start, end;
+	};
+
+	// The runs of a strip of rows, with the union-find forest over them and the totals of each tree
+	struct Strip
+	{
+		int rowBegin, rowEnd;
+		std::vector<Run> runs;
+		std::vector<int> parent;
+		std::vector<Blob> totals; // Only meaningful at roots
+		size_t firstRowEnd; // Runs before this are in the first row of the strip
+		size_t lastRowBegin; // Runs from this on are in the last row of the strip
+	};
+
+	std::vector<Strip> strips;
+
+	// Combined forest used when joining strips
+	std::vector<int> parent;
+	std::vector<Blob> totals;
+	std::vector<int> offsets; // Index in the combined forest of the first run of each strip
+
+	void labelStrip( const cv::Mat&, int );
+	static int find( std::vector<int>&, int );
+	static void join( std::vector<int>&, std::vector<Blob>&, int, int );
+	static void joinTouching( const std::vector<Run>&, size_t, size_t, int, const std::vector<Run>&, size_t, size_t, int,
+	                          std::vector<int>&, std::vector<Blob>& );
+	static int collect( std::vector<int>&, std::vector<Blob>&, int, int, std::vector<Blob>* );
+};
+
+#endif /* BLOBLABELER_H_ */
@@ -0,0 +1,256 @@
+/*
+ * Centroid.cpp
+ *
+ *	Source file containing intensity weighted centroids. Each pixel of a spot is weighted by how far its brightness rises above the
+ *	darkest pixel around the spot, so the centre follows the peak of the light rather than the edge of the thresholded blob.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "Centroid.h"
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+using namespace cv;
+
+// ================================= Variables ================================= //
+
+// Pixels added around a blob's bounding box so the faint edge of the spot, which fell below the threshold, still counts
+const int centroidMargin = 1;
+
+// What each pixel of the window around a spot is to the spot
+enum CentroidPixel
+{
+	PIXEL_OUTSIDE = 0, // Not weighted
+	PIXEL_EDGE = 1, // Outside the mask but touching the spot, weighted by half
+	PIXEL_SPOT = 2 // In the mask and connected to the spot, weighted in full
+};
+
+// ================================= End Variables ================================= //
+
+/*
+ * Marks in 'pixels', one entry per pixel of 'window', the pixels of the spot whose blob has bounding box 'box': the largest group of
+ * 8-connected masked pixels inside the box, and the pixels outside the mask touching it. Masked pixels of another blob that reach
+ * into the box, and the light around them, are left out. Returns the number of pixels of the spot.
+ */
+static int markSpot( const Mat &mask, const Rect &box, const Rect &window, std::vector<uchar> *pixels )
+{
+	// Kept by each thread from call to call, so that once the largest spot has been seen nothing is allocated
+	static thread_local std::vector<int> labels, stack;
+
+	const int width = window.width;
+	int best = 0, bestSize = 0, label = 0;
+
+	labels.assign( window.area(), 0 );
+	pixels->assign( window.area(), PIXEL_OUTSIDE );
+
+	for ( int y = box.y; y < box.y + box.height; y++ )
+	{
+		const uchar *maskRow = mask.ptr<uchar>(y);
+
+		for ( int x = box.x; x < box.x + box.width; x++ )
+		{
+			if ( maskRow[x] == 0 || labels[ ( y - window.y ) * width + x - window.x ] != 0 )
+				continue;
+
+			// Flood the group of masked pixels inside the box that this pixel is in
+			int size = 0;
+			label++;
+			labels[ ( y - window.y ) * width + x - window.x ] = label;
+			stack.assign( 1, ( y - window.y ) * width + x - window.x );
+
+			while ( !stack.empty() )
+			{
+				int i = stack.back(), px = i % width + window.x, py = i / width + window.y;
+				stack.pop_back();
+				size++;
+
+				for ( int ny = std::max( py - 1, box.y ); ny <= std::min( py + 1, box.y + box.height - 1 ); ny++ )
+				{
+					const uchar *neighbourRow = mask.ptr<uchar>(ny);
+
+					for ( int nx = std::max( px - 1, box.x ); nx <= std::min( px + 1, box.x + box.width - 1 ); nx++ )
+					{
+						int n = ( ny - window.y ) * width + nx - window.x;
+
+						if ( neighbourRow[nx] != 0 && labels[n] == 0 )
+						{
+							labels[n] = label;
+							stack.push_back( n );
+						}
+					}
+				}
+			}
+
+			if ( size > bestSize )
+			{
+				best = label;
+				bestSize = size;
+			}
+		}
+	}
+
+	// The spot, then the unmasked pixels touching it
+	for ( int i = 0; i < window.area(); i++ )
+		if ( labels[i] == best && best != 0 ) (*pixels)[i] = PIXEL_SPOT;
+
+	for ( int y = 0; y < window.height; y++ )
+	{
+		for ( int x = 0; x < width; x++ )
+		{
+			if ( (*pixels)[ y * width + x ] != PIXEL_SPOT )
+				continue;
+
+			for ( int ny = std::max( y - 1, 0 ); ny <= std::min( y + 1, window.height - 1 ); ny++ )
+				for ( int nx = std::max( x - 1, 0 ); nx <= std::min( x + 1, width - 1 ); nx++ )
+					if ( labels[ ny * width + nx ] == 0 ) (*pixels)[ ny * width + nx ] = PIXEL_EDGE;
+		}
+	}
+
+	return bestSize;
+}
+
+/*
+ * Finds the intensity weighted centre of the spot inside 'box' and puts it into 'centre', in pixels of 'image'. 'image' is an 8 bit
+ * gray image giving the brightness of each pixel in the terms the spot was segmented by, such as the difference image the mask was
+ * thresholded from or the HSV value of a colour frame, and 'mask' is the thresholded image the spot was found in.
+ *
+ * Pixels of the spot's blob are weighted by their brightness above the darkest pixel around the box, and unmasked pixels touching
+ * the blob by half that, so light spilling past the threshold still pulls the centre. Only pixels connected to the blob count, so a
+ * neighbouring spot that reaches into the box, as on a dense grid, does not pull it. If the spot is flat, every pixel of the blob is
+ * weighted equally and the binary centre is returned.
+ *
+ * 'uncertainty' gets the standard error of the centre in pixels: the weighted spread of the spot divided by the square root of the
+ * effective number of pixels. Returns false if the box holds no masked pixels.
+ */
+bool refineCentroid( const Mat &image, const Mat &mask, const Rect &box, Point2f *centre, float *uncertainty )
+{
+	CV_Assert( image.type() == CV_8UC1 && mask.type() == CV_8UC1 );
+	CV_Assert( image.size() == mask.size() );
+
+	Rect window( box.x - centroidMargin, box.y - centroidMargin, box.width + 2 * centroidMargin, box.height + 2 * centroidMargin );
+	window &= Rect( 0, 0, image.cols, image.rows );
+
+	// What each pixel of the window is to the spot, kept by each thread like the labels in markSpot
+	static thread_local std::vector<uchar> pixels;
+
+	if ( markSpot( mask, box & window, window, &pixels ) == 0 )
+		return false;
+
+	int background = 255;
+
+	// Darkest pixel around the spot
+	for ( int y = window.y; y < window.y + window.height; y++ )
+	{
+		const uchar *row = image.ptr<uchar>(y);
+
+		for ( int x = window.x; x < window.x + window.width; x++ )
+			background = std::min( background, (int)row[x] );
+	}
+
+	// Weighted sums, accumulated relative to the window corner to keep them small
+	double w = 0, wx = 0, wy = 0, wxx = 0, wyy = 0, ww = 0;
+
+	for ( int pass = 0; pass < 2 && w == 0; pass++ )
+	{
+		w = wx = wy = wxx = wyy = ww = 0;
+
+		for ( int y = window.y; y < window.y + window.height; y++ )
+		{
+			const uchar *row = image.ptr<uchar>(y);
+			const uchar *kind = &pixels[ ( y - window.y ) * window.width ];
+
+			for ( int x = window.x; x < window.x + window.width; x++ )
+			{
+				double weight;
+
+				// Flat spot; fall back to the binary centre on the second pass
+				if ( pass == 1 )
+					weight = ( kind[x - window.x] == PIXEL_SPOT ? 1 : 0 );
+				else
+					weight = ( row[x] - background ) * ( kind[x - window.x] == PIXEL_SPOT ? 1.0 :
+					                                                            kind[x - window.x] == PIXEL_EDGE ? 0.5 : 0 );
+
+				if ( weight == 0 ) continue;
+
+				double dx = x - window.x, dy = y - window.y;
+				w += weight;
+				wx += weight * dx;
+				wy += weight * dy;
+				wxx += weight * dx * dx;
+				wyy += weight * dy * dy;
+				ww += weight * weight;
+			}
+		}
+	}
+
+	double cx = wx / w, cy = wy / w;
+	double spread = std::max( 0.0, wxx / w - cx * cx ) + std::max( 0.0, wyy / w - cy * cy );
+	double effectivePixels = w * w / ww;
+
+	centre->x = (float)( window.x + cx );
+	centre->y = (float)( window.y + cy );
+	*uncertainty = (float)sqrt( spread / effectivePixels );
+	return true;
+}
+
+/*
+ * Checks refineCentroid on synthetic spots. Each trial draws a Gaussian spot at a random subpixel position with a second spot
+ * 'spacing' pixels away in a random direction, as on a dense grid, adds a little noise and thresholds at half the peak height. The
+ * spot's box is the box of the masked pixels nearer to it than to its neighbour, which may take in the near edge of the neighbour.
+ * Returns true if every refined centre is within 'tolerance' pixels of the true centre, and puts the largest error into
+ * 'worstError' if it is given.
+ */
+bool checkCentroids( float tolerance, float spacing, float *worstError )
+{
+	const int size = 32, trials = 200;
+	const float sigma = 1.2f, peak = 200, level = 20;
+	RNG rng( 4242 );
+	Mat image( size, size, CV_8UC1 ), mask( size, size, CV_8UC1 );
+	float worst = 0;
+
+	for ( int t = 0; t < trials; t++ )
+	{
+		Point2f spot( size / 2 + rng.uniform( -0.5f, 0.5f ), size / 2 + rng.uniform( -0.5f, 0.5f ) );
+		float angle = rng.uniform( 0.f, (float)( 2 * CV_PI ) );
+		Point2f neighbour( spot.x + spacing * cosf( angle ), spot.y + spacing * sinf( angle ) );
+		int x0 = size, y0 = size, x1 = -1, y1 = -1;
+
+		for ( int y = 0; y < size; y++ )
+		{
+			uchar *row = image.ptr<uchar>(y);
+			uchar *maskRow = mask.ptr<uchar>(y);
+
+			for ( int x = 0; x < size; x++ )
+			{
+				float d0 = ( x - spot.x ) * ( x - spot.x ) + ( y - spot.y ) * ( y - spot.y );
+				float d1 = ( x - neighbour.x ) * ( x - neighbour.x ) + ( y - neighbour.y ) * ( y - neighbour.y );
+				float value = level + peak * ( expf( -d0 / ( 2 * sigma * sigma ) ) + expf( -d1 / ( 2 * sigma * sigma ) ) )
+				              + rng.uniform( -2.f, 2.f );
+
+				row[x] = saturate_cast<uchar>( value );
+				maskRow[x] = ( value > level + peak / 2 ? 255 : 0 );
+
+				if ( maskRow[x] != 0 && d0 < d1 )
+				{
+					x0 = std::min( x0, x ); x1 = std::max( x1, x );
+					y0 = std::min( y0, y ); y1 = std::max( y1, y );
+				}
+			}
+		}
+
+		Rect box( x0, y0, x1 - x0 + 1, y1 - y0 + 1 );
+		Point2f centre;
+		float uncertainty;
+
+		if ( !refineCentroid( image, mask, box, &centre, &uncertainty ) )
+			return false;
+
+		worst = std::max( worst, (float)sqrt( ( centre.x - spot.x ) * ( centre.x - spot.x ) + ( centre.y - spot.y ) * ( centre.y - spot.y ) ) );
+	}
+
+	if ( worstError ) *worstError = worst;
+	return worst <= tolerance;
+}
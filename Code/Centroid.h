@@ -0,0 +1,19 @@
+/*
+ * Centroid.h
+ *
+ * Header file for subpixel centroid refinement. A spot's centre is found from the brightness of its pixels rather than only from
+ * which pixels passed the threshold, so spots can be placed to a fraction of a pixel in a downscaled frame.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <opencv/cv.h>
+
+#ifndef CENTROID_H_
+#define CENTROID_H_
+
+bool refineCentroid( const cv::Mat &image, const cv::Mat &mask, const cv::Rect &box, cv::Point2f *centre, float *uncertainty );
+bool checkCentroids( float tolerance = 0.2f, float spacing = 5, float *worstError = NULL );
+
+#endif /* CENTROID_H_ */
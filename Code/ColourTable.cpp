@@ -0,0 +1,202 @@
+/*
+ * ColourTable.cpp
+ *
+ *	Source file containing a BGR to binary mask lookup table for segmenting images by HSV colour range.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "ColourTable.h"
+
+using namespace cv;
+
+// ===================================================
+// 				COLOUR TABLE CLASS
+// ===================================================
+
+/*
+ *	Constructor for ColourTable class that allows input of how many bits of each channel are used to index the table. 6 bits
+ *	gives a 256KB table that stays in cache; 8 bits gives a 16MB table that matches inRange exactly.
+ */
+ColourTable::ColourTable( int bits ) : bits( bits ), built( false )
+{
+	CV_Assert( bits >= 1 && bits <= 8 );
+}
+
+ColourTable::~ColourTable() { }
+
+// ============= Functions
+/*
+ * Sets how many bits of each channel index the table. The table is rebuilt at the new size when it is next given its ranges.
+ */
+void ColourTable::setBits( int newBits )
+{
+	CV_Assert( newBits >= 1 && newBits <= 8 );
+
+	if ( newBits == bits )
+		return;
+
+	bits = newBits;
+	built = false;
+}
+
+/*
+ * Sets the single HSV range pixels must lie inside. The table is only rebuilt if the range has changed, and the range is stored
+ * in place, so calling this every frame allocates nothing.
+ */
+void ColourTable::setRange( const HSVRange &range )
+{
+	if ( built && ranges.size() == 1 && ranges[0] == range )
+		return;
+
+	ranges.assign( 1, range );
+	build();
+}
+
+/*
+ * Sets the HSV range of each colour class, up to 'maxClasses' of them. The table is only rebuilt if a range has changed.
+ */
+void ColourTable::setRanges( const std::vector<HSVRange> &newRanges )
+{
+	CV_Assert( newRanges.size() >= 1 && (int)newRanges.size() <= maxClasses );
+
+	if ( built && newRanges == ranges )
+		return;
+
+	ranges = newRanges;
+	build();
+}
+
+/*
+ * Returns how many colour classes the table looks up
+ */
+int ColourTable::numberOfClasses() const
+{
+	return ranges.size();
+}
+
+/*
+ * Sets each pixel of 'mask' to 255 if the colour of the same pixel of 'src' lies inside the HSV range of class 'classIndex', and to
+ * 0 otherwise. This is one table lookup per pixel, with no HSV image in between.
+ */
+void ColourTable::segment( const Mat &src, Mat *mask, int classIndex )
+{
+	CV_Assert( built && src.type() == CV_8UC3 && classIndex >= 0 && classIndex < (int)ranges.size() );
+
+	const int shift = 8 - bits;
+	const uchar *lookup = &table[0];
+
+	mask->create( src.size(), CV_8UC1 );
+
+	for ( int y = 0; y < src.rows; y++ )
+	{
+		const uchar *p = src.ptr<uchar>(y);
+		uchar *m = mask->ptr<uchar>(y);
+
+		for ( int x = 0; x < src.cols; x++, p += 3 )
+		{
+			uchar classes = lookup[ ((p[0] >> shift) << (2 * bits)) | ((p[1] >> shift) << bits) | (p[2] >> shift) ];
+			m[x] = (uchar)( -( (classes >> classIndex) & 1 ) );
+		}
+	}
+}
+
+/*
+ * Sets each pixel of 'labels' to the set of colour classes the same pixel of 'src' belongs to: bit k is set if the pixel lies
+ * inside range k. Every class is found in this one pass, so the cost does not grow with the number of classes.
+ */
+void ColourTable::segmentClasses( const Mat &src, Mat *labels )
+{
+	CV_Assert( built && src.type() == CV_8UC3 );
+
+	const int shift = 8 - bits;
+	const uchar *lookup = &table[0];
+
+	labels->create( src.size(), CV_8UC1 );
+
+	for ( int y = 0; y < src.rows; y++ )
+	{
+		const uchar *p = src.ptr<uchar>(y);
+		uchar *l = labels->ptr<uchar>(y);
+
+		for ( int x = 0; x < src.cols; x++, p += 3 )
+		{
+			l[x] = lookup[ ((p[0] >> shift) << (2 * bits)) | ((p[1] >> shift) << bits) | (p[2] >> shift) ];
+		}
+	}
+}
+
+/*
+ * Sets each pixel of 'mask' to 255 if bit 'classIndex' of the same pixel of 'labels' is set, and to 0 otherwise
+ */
+void ColourTable::extractClass( const Mat &labels, int classIndex, Mat *mask )
+{
+	CV_Assert( labels.type() == CV_8UC1 );
+
+	mask->create( labels.size(), CV_8UC1 );
+
+	for ( int y = 0; y < labels.rows; y++ )
+	{
+		const uchar *l = labels.ptr<uchar>(y);
+		uchar *m = mask->ptr<uchar>(y);
+
+		for ( int x = 0; x < labels.cols; x++ )
+			m[x] = (uchar)( -( (l[x] >> classIndex) & 1 ) );
+	}
+}
+
+/*
+ * Fills the table by converting the centre of every quantised BGR colour to HSV and checking it against each range. All colours
+ * are converted in one image so OpenCV's own conversion decides each entry.
+ */
+void ColourTable::build()
+{
+	const int levels = 1 << bits;
+	const int shift = 8 - bits;
+	const int centre = ( bits < 8 ? 1 << (shift - 1) : 0 );
+	Mat colours( levels * levels, levels, CV_8UC3 ), hsv, result;
+
+	// Row (b, g) and column r of 'colours' is entry ( b << 2 * bits | g << bits | r ) of the table
+	for ( int b = 0; b < levels; b++ )
+	{
+		for ( int g = 0; g < levels; g++ )
+		{
+			uchar *p = colours.ptr<uchar>( b * levels + g );
+
+			for ( int r = 0; r < levels; r++, p += 3 )
+			{
+				p[0] = (uchar)( (b << shift) | centre );
+				p[1] = (uchar)( (g << shift) | centre );
+				p[2] = (uchar)( (r << shift) | centre );
+			}
+		}
+	}
+
+	cvtColor( colours, hsv, CV_BGR2HSV );
+
+	table.assign( colours.total(), 0 );
+
+	for ( size_t k = 0; k < ranges.size(); k++ )
+	{
+		const HSVRange &range = ranges[k];
+		inRange( hsv, Scalar(range.hMin, range.sMin, range.vMin), Scalar(range.hMax, range.sMax, range.vMax), result );
+
+		const uchar *r = result.ptr<uchar>(0);
+		for ( size_t i = 0; i < table.size(); i++ )
+		{
+			if ( r[i] ) table[i] |= (uchar)( 1 << k );
+		}
+	}
+
+	built = true;
+}
+
+/*
+ * Returns true if two HSV ranges are the same
+ */
+bool operator==( const HSVRange &a, const HSVRange &b )
+{
+	return a.hMin == b.hMin && a.sMin == b.sMin && a.vMin == b.vMin &&
+	       a.hMax == b.hMax && a.sMax == b.sMax && a.vMax == b.vMax;
+}
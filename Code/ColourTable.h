@@ -0,0 +1,53 @@
+/*
+ * ColourTable.h
+ *
+ * Header file for a lookup table that segments a BGR image by HSV colour range without converting it to HSV. The table holds
+ * the result for every (quantised) BGR colour, and is only rebuilt when the HSV ranges change. Up to 8 ranges (colour classes) can
+ * be looked up at once, each result being one bit of the table entry.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <opencv/cv.h>
+#include <vector>
+
+#ifndef COLOURTABLE_H_
+#define COLOURTABLE_H_
+
+typedef struct HSVRange
+{
+	int hMin, sMin, vMin;
+	int hMax, sMax, vMax;
+} HSVRange;
+
+class ColourTable {
+public:
+	// Constructors
+	ColourTable( int bits = 6 );
+	~ColourTable();
+
+	// Variables
+	static const int maxClasses = 8;
+
+	// Functions
+	void setBits( int );
+	void setRange( const HSVRange& );
+	void setRanges( const std::vector<HSVRange>& );
+	int numberOfClasses() const;
+	void segment( const cv::Mat&, cv::Mat*, int classIndex = 0 );
+	void segmentClasses( const cv::Mat&, cv::Mat* );
+	static void extractClass( const cv::Mat&, int, cv::Mat* );
+
+private:
+	int bits; // Bits kept from each BGR channel; 8 gives exactly the same result as inRange on the HSV image
+	bool built;
+	std::vector<HSVRange> ranges;
+	std::vector<uchar> table; // Bit k of each entry is set if the colour lies inside range k
+
+	void build();
+};
+
+bool operator==( const HSVRange&, const HSVRange& );
+
+#endif /* COLOURTABLE_H_ */
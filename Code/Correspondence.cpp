@@ -0,0 +1,471 @@
+/*
+ * Correspondence.cpp
+ *
+ *	Source file containing the correspondence index, which projects each pattern point's ray into the image between the nearest and
+ *	furthest depths, sorts the resulting epipolar segments into a grid by cell and matches each spot against the segments of its
+ *	own cell. Candidates are taken best first, by their distance from the segment and from the depth voted for around the spot.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "Correspondence.h"
+#include <math.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+// ================================= Variables ================================= //
+
+// Directions closer than this to being parallel to the image plane never change depth, so give no segment
+const float minDepthChange = 0.000001f;
+
+// Segments whose ends are closer than this in inverse depth are taken to be at one depth
+const float minInverseChange = 1e-12f;
+
+// ================================= End Variables ================================= //
+
+// ===================================================
+// ============= CORRESPONDENCE INDEX ================
+// ===================================================
+
+CorrespondenceIndex::CorrespondenceIndex()
+{
+	nearDepth = 500;
+	farDepth = 2000;
+	tolerance = 2;
+	cellSize = 0;
+	regionSpacings = 8;
+	depthBins = 32;
+	candidatesTested = 0;
+	cell = 1;
+	cols = rows = 0;
+	regionCells = 1;
+	regionCols = regionRows = 0;
+	inverseNear = inverseFar = 0;
+	stamp = 0;
+}
+
+CorrespondenceIndex::~CorrespondenceIndex() { }
+
+// ============= Functions
+/*
+ * Indexes the pattern points whose rays run from 'origins' along 'directions', as seen by 'camera'. Spots will be given in pixels
+ * of frames 'width' by 'height', scaled by 'scale' from the full size frames the camera was calibrated with. Must be built again
+ * when the camera, the pattern, the depth range or the tolerance change.
+ *
+ * Unless 'cellSize' is set, a cell is as wide as the mean spacing of the pattern points in the image, or twice the tolerance if that
+ * is wider. A spot is then measured against the few segments that pass near it rather than against every segment of a cell that
+ * holds many pattern points, and a segment is not listed in so many cells that building the index is slow.
+ */
+void CorrespondenceIndex::build( const CameraModel &camera, const RayBatch &origins, const RayBatch &directions, int width, int height,
+                                 float scale )
+{
+	const Matrix3D toCamera = camera.orientation.matrix.transpose();
+
+	// Bounds of the segments in the frame, for the spacing of the pattern
+	float left = width, top = height, right = 0, bottom = 0;
+	int valid = 0;
+
+	segments.resize( directions.size() );
+	entries.clear();
+
+	for ( size_t k = 0; k < directions.size(); k++ )
+	{
+		Segment &segment = segments[k];
+		segment.valid = false;
+
+		// The ray in the camera's axes: depth along it is origin.z + t * direction.z
+		Vector3D origin = toCamera * ( origins.get( k ) - camera.origin );
+		Vector3D direction = toCamera * directions.get( k );
+
+		if ( fabs( direction.p.z ) < minDepthChange )
+			continue;
+
+		float t0 = ( nearDepth - origin.p.z ) / direction.p.z, t1 = ( farDepth - origin.p.z ) / direction.p.z;
+		if ( t0 > t1 ) std::swap( t0, t1 );
+
+		// Only the part of the ray in front of the projector
+		t0 = max( t0, 0.f );
+		if ( t1 < t0 )
+			continue;
+
+		Vector3D nearest = origin + direction * t0, furthest = origin + direction * t1;
+		if ( nearest.p.z <= 0 || furthest.p.z <= 0 )
+			continue;
+
+		// Into the scaled frame, whose pixel edges rather than pixel centres line up with the full size frame's
+		segment.start.x = ( camera.focalX * nearest.p.x / nearest.p.z + camera.centreX + 0.5f ) * scale - 0.5f;
+		segment.start.y = ( camera.focalY * nearest.p.y / nearest.p.z + camera.centreY + 0.5f ) * scale - 0.5f;
+		segment.end.x = ( camera.focalX * furthest.p.x / furthest.p.z + camera.centreX + 0.5f ) * scale - 0.5f;
+		segment.end.y = ( camera.focalY * furthest.p.y / furthest.p.z + camera.centreY + 0.5f ) * scale - 0.5f;
+		segment.inverseStart = 1 / nearest.p.z;
+		segment.inverseEnd = 1 / furthest.p.z;
+		segment.valid = true;
+
+		left = min( left, min( segment.start.x, segment.end.x ) );
+		right = max( right, max( segment.start.x, segment.end.x ) );
+		top = min( top, min( segment.start.y, segment.end.y ) );
+		bottom = max( bottom, max( segment.start.y, segment.end.y ) );
+		valid++;
+	}
+
+	// Mean spacing of the pattern points, clipped to the frame
+	left = max( left, 0.f ); right = min( right, (float)width );
+	top = max( top, 0.f ); bottom = min( bottom, (float)height );
+
+	float area = max( right - left, 1.f ) * max( bottom - top, 1.f );
+	float spacing = ( valid > 0 ? sqrt( area / valid ) : (float)max( width, height ) );
+
+	cell = ( cellSize > 0 ? cellSize : max( 2 * tolerance, spacing ) );
+	cols = max( (int)ceil( width / cell ), 1 );
+	rows = max( (int)ceil( height / cell ), 1 );
+
+	for ( size_t k = 0; k < segments.size(); k++ )
+		if ( segments[k].valid ) addSegment( k );
+
+	// Regions a few pattern points across vote for the depth of the surface there
+	regionCells = max( (int)ceil( regionSpacings * spacing / cell ), 1 );
+	regionCols = ( cols + regionCells - 1 ) / regionCells;
+	regionRows = ( rows + regionCells - 1 ) / regionCells;
+	inverseNear = 1 / nearDepth;
+	inverseFar = 1 / farDepth;
+
+	// Counting sort of the entries by cell
+	cellStart.assign( cols * rows + 1, 0 );
+
+	for ( size_t e = 0; e < entries.size(); e++ )
+		cellStart[ entries[e].cell + 1 ]++;
+
+	for ( int c = 0; c < cols * rows; c++ )
+		cellStart[c + 1] += cellStart[c];
+
+	items.resize( entries.size() );
+	cellNext.assign( cellStart.begin(), cellStart.end() - 1 );
+
+	for ( size_t e = 0; e < entries.size(); e++ )
+		items[ cellNext[ entries[e].cell ]++ ] = entries[e].patternIndex;
+
+	testedStamp.assign( segments.size(), 0 );
+	claimedStamp.assign( segments.size(), 0 );
+	stamp = 0;
+}
+
+/*
+ * Matches each spot centre of 'spots' to the pattern point that made it, putting the index of the pattern point of each spot into
+ * 'patternPoints', or -1 where a spot has no pattern point within the tolerance. Each pattern point is given to at most one spot.
+ *
+ * Every pattern point whose segment passes within the tolerance of a spot is a candidate, at the depth where its ray would meet
+ * the spot's. The candidates of each region vote for the depth most of them agree on, which is the surface's, as only the true
+ * candidates of neighbouring spots share a depth. Pairs are then taken best first, by their distance from the segment plus how far
+ * along it they are from the region's depth, both in pixels. Returns the number of spots matched.
+ */
+int CorrespondenceIndex::match( const vector<Point2D> &spots, vector<int> *patternPoints )
+{
+	patternPoints->assign( spots.size(), -1 );
+	pairs.clear();
+	candidatesTested = 0;
+
+	if ( segments.empty() )
+		return 0;
+
+	// Stamps are compared for equality, so they are cleared before the counter could wrap
+	if ( stamp > INT_MAX - (int)spots.size() - 2 )
+	{
+		std::fill( testedStamp.begin(), testedStamp.end(), 0 );
+		std::fill( claimedStamp.begin(), claimedStamp.end(), 0 );
+		stamp = 0;
+	}
+
+	for ( size_t i = 0; i < spots.size(); i++ )
+	{
+		int c = cellOf( spots[i] );
+		if ( c < 0 )
+			continue;
+
+		int region = ( c / cols / regionCells ) * regionCols + ( c % cols ) / regionCells;
+
+		// A segment can be listed in a cell more than once, but is only measured once per spot
+		stamp++;
+
+		for ( int e = cellStart[c]; e < cellStart[c + 1]; e++ )
+		{
+			int k = items[e];
+
+			if ( testedStamp[k] == stamp )
+				continue;
+
+			testedStamp[k] = stamp;
+			candidatesTested++;
+
+			float along;
+			float distance = distanceToSegment( spots[i], segments[k], &along );
+			if ( distance <= tolerance )
+			{
+				const Segment &segment = segments[k];
+				Pair pair = { 0, distance, segment.inverseStart + along * ( segment.inverseEnd - segment.inverseStart ), (int)i, k, region };
+				pairs.push_back( pair );
+			}
+		}
+	}
+
+	voteDepths();
+
+	for ( size_t p = 0; p < pairs.size(); p++ )
+	{
+		Pair &pair = pairs[p];
+		const Segment &segment = segments[ pair.patternIndex ];
+		Point2D along = segment.end - segment.start;
+		float inverseChange = fabs( segment.inverseEnd - segment.inverseStart );
+
+		// Pixels along this segment per unit of inverse depth
+		float pixelsPerInverse = ( inverseChange > minInverseChange ? sqrtf( along.x * along.x + along.y * along.y ) / inverseChange : 0 );
+
+		pair.cost = pair.distance + fabs( pair.inverseDepth - regionDepth[ pair.region ] ) * pixelsPerInverse;
+	}
+
+	std::sort( pairs.begin(), pairs.end() );
+
+	int matched = 0;
+	stamp++;
+
+	for ( size_t p = 0; p < pairs.size(); p++ )
+	{
+		if ( claimedStamp[ pairs[p].patternIndex ] == stamp || (*patternPoints)[ pairs[p].spotIndex ] >= 0 )
+			continue;
+
+		claimedStamp[ pairs[p].patternIndex ] = stamp;
+		(*patternPoints)[ pairs[p].spotIndex ] = pairs[p].patternIndex;
+		matched++;
+	}
+
+	return matched;
+}
+
+/*
+ * Finds the depth the candidates of each region agree on: the depth bin with the most candidates, refined to the mean of the
+ * candidates in it and the bins either side. The result is put into 'regionDepth' as one over the depth.
+ */
+void CorrespondenceIndex::voteDepths()
+{
+	const int regions = regionCols * regionRows;
+
+	votes.assign( regions * depthBins, 0 );
+
+	for ( size_t p = 0; p < pairs.size(); p++ )
+	{
+		float closeness = 1 - pairs[p].distance / tolerance;
+		votes[ pairs[p].region * depthBins + depthBin( pairs[p].inverseDepth ) ] += closeness * closeness;
+	}
+
+	// The bin voted for most, kept in 'depthCounts' until the mean around it is found
+	depthCounts.assign( regions, 0 );
+
+	for ( int r = 0; r < regions; r++ )
+	{
+		const float *v = &votes[ r * depthBins ];
+		depthCounts[r] = (int)( std::max_element( v, v + depthBins ) - v );
+	}
+
+	depthSums.assign( regions, 0 );
+	regionDepth.assign( regions, 0 );
+
+	for ( size_t p = 0; p < pairs.size(); p++ )
+	{
+		const Pair &pair = pairs[p];
+
+		if ( abs( depthBin( pair.inverseDepth ) - depthCounts[ pair.region ] ) <= 1 )
+		{
+			depthSums[ pair.region ] += pair.inverseDepth;
+			regionDepth[ pair.region ] += 1;
+		}
+	}
+
+	for ( int r = 0; r < regions; r++ )
+		regionDepth[r] = ( regionDepth[r] > 0 ? depthSums[r] / regionDepth[r] : ( inverseNear + inverseFar ) / 2 );
+}
+
+/*
+ * Returns the depth bin of one over a depth, from 0 at the furthest depth to 'depthBins' - 1 at the nearest
+ */
+int CorrespondenceIndex::depthBin( float inverseDepth ) const
+{
+	int bin = (int)( ( inverseDepth - inverseFar ) / ( inverseNear - inverseFar ) * depthBins );
+	return min( max( bin, 0 ), depthBins - 1 );
+}
+
+/*
+ * Lists pattern point 'k' in every cell its segment comes within the tolerance of. The segment is cut into pieces no longer than a
+ * cell, and the cells around each piece are used, so a long diagonal segment is not listed across its whole bounding box.
+ */
+void CorrespondenceIndex::addSegment( int k )
+{
+	const Segment &segment = segments[k];
+	Point2D along = segment.end - segment.start;
+	int pieces = max( (int)ceil( sqrt( along.x * along.x + along.y * along.y ) / cell ), 1 );
+
+	for ( int p = 0; p < pieces; p++ )
+	{
+		Point2D a = segment.start + along * ( (float)p / pieces ), b = segment.start + along * ( (float)( p + 1 ) / pieces );
+
+		int x0 = (int)floor( ( min( a.x, b.x ) - tolerance ) / cell ), x1 = (int)floor( ( max( a.x, b.x ) + tolerance ) / cell );
+		int y0 = (int)floor( ( min( a.y, b.y ) - tolerance ) / cell ), y1 = (int)floor( ( max( a.y, b.y ) + tolerance ) / cell );
+
+		x0 = max( x0, 0 ); x1 = min( x1, cols - 1 );
+		y0 = max( y0, 0 ); y1 = min( y1, rows - 1 );
+
+		for ( int y = y0; y <= y1; y++ )
+			for ( int x = x0; x <= x1; x++ )
+			{
+				Entry entry = { y * cols + x, k };
+				entries.push_back( entry );
+			}
+	}
+}
+
+/*
+ * Returns the cell holding 'p', or -1 if it is outside the frame
+ */
+int CorrespondenceIndex::cellOf( Point2D p ) const
+{
+	int x = (int)floor( p.x / cell ), y = (int)floor( p.y / cell );
+
+	if ( x < 0 || y < 0 || x >= cols || y >= rows )
+		return -1;
+
+	return y * cols + x;
+}
+
+/*
+ * Returns the distance from 'p' to the nearest point of 'segment', and puts how far along the segment that point is, from 0 at its
+ * start to 1 at its end, into 'position'
+ */
+float CorrespondenceIndex::distanceToSegment( Point2D p, const Segment &segment, float *position )
+{
+	Point2D along = segment.end - segment.start, offset = p - segment.start;
+	float lengthSquared = along.x * along.x + along.y * along.y;
+	float t = ( lengthSquared > 0 ? ( offset.x * along.x + offset.y * along.y ) / lengthSquared : 0 );
+
+	t = min( max( t, 0.f ), 1.f );
+	*position = t;
+
+	float dx = offset.x - t * along.x, dy = offset.y - t * along.y;
+	return sqrtf( dx * dx + dy * dy );
+}
+
+
+/*
+ * Function to test the correspondence index with a made up camera and projector, the same as testTriangulation's but with the
+ * projector also a little above the camera so that epipolar lines cross the rows of the pattern at a slant. Spots are made from
+ * pattern points on a surface, jittered, shuffled, with some missing and some extra. Reports how many spots were matched to the
+ * right pattern point, how many candidates were measured per spot and the time taken, and the time taken by trying every pattern
+ * point for every spot.
+ *
+ * Returns true if, for every pattern, at least 'minRight' of the spots seen were matched right and no more than 'maxCandidates'
+ * candidates were measured per spot. The smallest fraction matched right is put into 'worstRight' if it is given.
+ */
+bool testCorrespondence( float minRight, float maxCandidates, float *worstRight )
+{
+	const int sides[] = { 3, 6, 32, 128 };
+	float worst = 1;
+	bool pass = true;
+
+	CameraModel camera;
+	camera.origin = Vector3D( 0, 0, 0 );
+	camera.focalX = camera.focalY = 800;
+	camera.centreX = 320;
+	camera.centreY = 240;
+
+	Vector3D projector( 100, 35, 0 );
+
+	srand( 1 );
+
+	for ( size_t s = 0; s < sizeof( sides ) / sizeof( sides[0] ); s++ )
+	{
+		const int side = sides[s];
+		const int count = side * side;
+
+		RayBatch origins( count ), directions( count );
+		vector<Point2D> spots;
+		vector<int> truth; // Pattern point of each spot, or -1 for an extra spot
+
+		for ( int i = 0; i < count; i++ )
+		{
+			// Each dot is moved at random within its place on the grid, as a regular grid repeats along the epipolar lines
+			float jitterU = ( rand() % 101 - 50 ) / 150.f, jitterV = ( rand() % 101 - 50 ) / 150.f;
+			float u = ( i % side + 0.5f + jitterU ) / side - 0.5f, v = ( i / side + 0.5f + jitterV ) / side - 0.5f;
+			Vector3D surface( 400 * u, 300 * v, 1000 + 50 * sinf( 6 * u ) * cosf( 4 * v ) );
+
+			origins.set( i, projector );
+			directions.set( i, surface - projector );
+
+			// One pattern point in twenty is not seen
+			if ( rand() % 20 == 0 )
+				continue;
+
+			Point2D spot = { 800 * surface.p.x / surface.p.z + 320 + ( rand() % 101 - 50 ) / 200.f,
+			                 800 * surface.p.y / surface.p.z + 240 + ( rand() % 101 - 50 ) / 200.f };
+
+			spots.push_back( spot );
+			truth.push_back( i );
+		}
+
+		// And one spot in fifty is a reflection or noise that matches nothing in the pattern
+		for ( int e = 0; e < count / 50; e++ )
+		{
+			Point2D spot = { (float)( rand() % 640 ), (float)( rand() % 480 ) };
+			spots.push_back( spot );
+			truth.push_back( -1 );
+		}
+
+		// Shuffle
+		for ( size_t i = spots.size() - 1; i > 0; i-- )
+		{
+			size_t j = rand() % ( i + 1 );
+			std::swap( spots[i], spots[j] );
+			std::swap( truth[i], truth[j] );
+		}
+
+		CorrespondenceIndex index;
+		index.nearDepth = 900;
+		index.farDepth = 1100;
+		index.tolerance = 1;
+		index.build( camera, origins, directions, 640, 480 );
+
+		vector<int> patternPoints;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		index.match( spots, &patternPoints );
+		chrono::duration<double, micro> indexTime = chrono::steady_clock::now() - start;
+
+		int right = 0, seen = 0;
+		for ( size_t i = 0; i < spots.size(); i++ )
+		{
+			if ( truth[i] >= 0 ) seen++;
+			if ( truth[i] >= 0 && patternPoints[i] == truth[i] ) right++;
+		}
+
+		// Every spot against every pattern point, for comparison
+		CorrespondenceIndex everything = index;
+		everything.cellSize = 1000;
+		everything.build( camera, origins, directions, 640, 480 );
+
+		start = chrono::steady_clock::now();
+		everything.match( spots, &patternPoints );
+		chrono::duration<double, micro> naiveTime = chrono::steady_clock::now() - start;
+
+		float rightFraction = (float)right / seen, candidates = (float)index.candidatesTested / spots.size();
+		worst = min( worst, rightFraction );
+		if ( rightFraction < minRight || candidates > maxCandidates ) pass = false;
+
+		cout << count << " pattern points: \t" << right << " of " << seen << " seen right, " << candidates << " candidates per spot, "
+		     << index.gridCellSize() << " px cells, " << indexTime.count() << " us indexed, " << naiveTime.count()
+		     << " us trying every point" << endl;
+	}
+
+	if ( worstRight ) *worstRight = worst;
+	return pass;
+}
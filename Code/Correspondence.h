@@ -0,0 +1,100 @@
+/*
+ * Correspondence.h
+ *
+ * Header file for matching the spots found in a frame to the points of the projected pattern that made them. A pattern point can
+ * only appear along its epipolar segment, the part of the image its projector ray crosses between the nearest and furthest depths
+ * expected, so the segments are indexed in a uniform grid and each spot is only measured against the segments passing its cell.
+ *
+ * On a dense pattern several segments pass within the tolerance of each spot, so the distance to a segment cannot tell them apart.
+ * Each candidate also gives the depth the spot would be at, and the true candidates of spots close together agree on it, as they lie
+ * on the same surface. The candidates of each region of the frame vote for a depth, and each spot takes the candidate nearest to
+ * both its segment and its region's depth.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "Triangulation.h"
+#include <vector>
+
+#ifndef CORRESPONDENCE_H_
+#define CORRESPONDENCE_H_
+
+class CorrespondenceIndex {
+public:
+	// Variables
+	float nearDepth, farDepth; // Range of depths along the camera's optical axis that spots can come from
+	float tolerance; // Furthest a spot can be in pixels from the epipolar segment of the pattern point it is matched to
+	float cellSize; // Side of a grid cell in pixels, or 0 to size the cells from the spacing of the pattern and the tolerance
+	int regionSpacings; // Side of the regions that vote for a depth, in pattern point spacings
+	int depthBins; // Depths each region votes between, from the nearest to the furthest
+	long long candidatesTested; // Spot and pattern point pairs measured by the last match, to show how much the grid prunes
+
+	// Constructors
+	CorrespondenceIndex();
+	~CorrespondenceIndex();
+
+	// Functions
+	void build( const CameraModel&, const RayBatch&, const RayBatch&, int, int, float scale = 1 );
+	int match( const std::vector<Point2D>&, std::vector<int>* );
+	size_t size() const { return segments.size(); }
+	float gridCellSize() const { return cell; }
+
+private:
+	// Where a pattern point can appear in the image, from its nearest to its furthest depth
+	struct Segment
+	{
+		Point2D start, end;
+		float inverseStart, inverseEnd; // One over the depth at each end; the image position is linear in it along a ray
+		bool valid; // False if the ray never reaches the range of depths in front of the camera
+	};
+
+	// A pattern point listed in a cell
+	struct Entry
+	{
+		int cell, patternIndex;
+	};
+
+	// A spot and a pattern point whose segment passes close enough to it
+	struct Pair
+	{
+		float cost; // Distance from the segment plus how far off the region's depth the spot would be, both in pixels
+		float distance;
+		float inverseDepth; // One over the depth the spot would be at
+		int spotIndex, patternIndex, region;
+
+		bool operator<( const Pair &other ) const { return cost < other.cost; }
+	};
+
+	std::vector<Segment> segments;
+
+	// Pattern points sorted by the cells their segments pass through; a segment is listed once in every cell it comes near
+	float cell; // Side of a cell in use
+	int cols, rows;
+	std::vector<int> cellStart; // Index into 'items' of the first pattern point of each cell, plus one past the end
+	std::vector<int> items;
+	std::vector<int> cellNext;
+	std::vector<Entry> entries; // Before they are sorted by cell
+
+	// Regions of 'regionCells' by 'regionCells' cells, and the depth bins each is voted into
+	int regionCells, regionCols, regionRows;
+	float inverseNear, inverseFar;
+	std::vector<float> votes;
+	std::vector<float> regionDepth, depthSums; // One over the depth most candidates of each region agree on
+	std::vector<int> depthCounts;
+
+	// Scratch for matching, stamped rather than cleared so a frame costs nothing per pattern point
+	std::vector<Pair> pairs;
+	std::vector<int> testedStamp, claimedStamp;
+	int stamp;
+
+	int cellOf( Point2D ) const;
+	int depthBin( float ) const;
+	void voteDepths();
+	void addSegment( int );
+	static float distanceToSegment( Point2D, const Segment&, float* );
+};
+
+bool testCorrespondence( float minRight = 0.95f, float maxCandidates = 64, float *worstRight = NULL );
+
+#endif /* CORRESPONDENCE_H_ */
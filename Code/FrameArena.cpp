@@ -0,0 +1,106 @@
+/*
+ * FrameArena.cpp
+ *
+ *	Source file containing the buffers reused by the tracking loop and the count of what each loop allocates.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "FrameArena.h"
+#include <algorithm>
+
+using namespace cv;
+
+// ===================================================
+// ================= FRAME ARENA =====================
+// ===================================================
+
+FrameArena::FrameArena()
+{
+	sized = false;
+	warmUpLoops = 2;
+	loopStart = lastLoop = steadyTotal = 0;
+	loops = 0;
+}
+
+FrameArena::~FrameArena() { }
+
+// ============= Functions
+/*
+ * Sizes the buffers from the first frame read, so that reading and inspecting later frames of the same size reuses them
+ */
+void FrameArena::prepare( const Mat &first )
+{
+	raw.create( first.size(), first.type() );
+	pixel.create( 1, 1, CV_8UC3 );
+	pixelHSV.create( 1, 1, CV_8UC3 );
+	sized = true;
+}
+
+/*
+ * Adds a Mat that each loop should write into without reallocating. Mats should be watched before the first loop.
+ */
+void FrameArena::watch( Mat *mat )
+{
+	watched.push_back( mat );
+}
+
+/*
+ * Adds a list of Mats that each loop should write into without reallocating. The list is asked for again at the start and end of
+ * every loop, so Mats can be added to it as they are made.
+ */
+void FrameArena::watch( BufferList list )
+{
+	lists.push_back( list );
+}
+
+/*
+ * Marks the start of the part of a loop that should not allocate
+ */
+void FrameArena::beginLoop()
+{
+	listWatched();
+
+	watchedData.resize( listed.size() );
+	for ( size_t i = 0; i < listed.size(); i++ )
+		watchedData[i] = listed[i]->data;
+
+	std::sort( watchedData.begin(), watchedData.end() );
+
+	loopStart = heapAllocations();
+}
+
+/*
+ * Marks the end of the part of a loop that should not allocate, counting what it allocated. Every watched Mat whose data was not
+ * the data of some watched Mat when the loop began is counted, which includes Mats sized for the first time and Mats added to a
+ * list during the loop. Mats that swap their buffers, as streamed frames do, are not counted.
+ */
+void FrameArena::endLoop()
+{
+	long long count = heapAllocations() - loopStart;
+
+	listWatched();
+
+	for ( size_t i = 0; i < listed.size(); i++ )
+		if ( listed[i]->data && !std::binary_search( watchedData.begin(), watchedData.end(), (const uchar*)listed[i]->data ) )
+			count++;
+
+	lastLoop = count;
+	loops++;
+
+	if ( loops > warmUpLoops )
+		steadyTotal += count;
+}
+
+/*
+ * Puts every Mat watched, one at a time or in a list, into 'listed'. Its storage is reused, so once the lists stop growing this
+ * does not allocate.
+ */
+void FrameArena::listWatched()
+{
+	listed.assign( watched.begin(), watched.end() );
+
+	for ( size_t i = 0; i < lists.size(); i++ )
+		lists[i]( &listed );
+}
@@ -0,0 +1,63 @@
+/*
+ * FrameArena.h
+ *
+ * Header file for the buffers the tracking loop works in, sized from the first frame so that later frames reuse them, and for
+ * counting what each loop allocates to show whether the loop has stopped allocating.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <opencv/cv.h>
+#include "HeapCounter.h"
+#include <vector>
+
+#ifndef FRAMEARENA_H_
+#define FRAMEARENA_H_
+
+/*
+ * Puts pointers to a set of Mats into the vector given, for Mats that come and go, such as the scratch space of a tracker
+ */
+typedef void (*BufferList)( std::vector<cv::Mat*>* );
+
+/*
+ * Buffers reused by every loop of the tracking program. Frames tracked elsewhere can be watched too: a watched Mat whose data
+ * moves during a loop was reallocated, which OpenCV does through its own allocator rather than operator new, so it is counted as
+ * an allocation of that loop.
+ */
+class FrameArena {
+public:
+	// Variables
+	cv::Mat raw; // Frame as captured, before it is scaled
+	cv::Mat pixel, pixelHSV; // Pixel under the mouse and its HSV colour
+	bool sized; // Whether the buffers have been sized from a first frame
+	int warmUpLoops; // Loops that may allocate while the buffers settle, before allocations count as steady state
+
+	// Constructors
+	FrameArena();
+	~FrameArena();
+
+	// Functions
+	void prepare( const cv::Mat& );
+	void watch( cv::Mat* );
+	void watch( BufferList );
+	void beginLoop();
+	void endLoop();
+	void restartWarmUp() { loops = 0; }
+	long long loopAllocations() const { return lastLoop; }
+	long long steadyAllocations() const { return steadyTotal; }
+
+private:
+	std::vector<cv::Mat*> watched;
+	std::vector<BufferList> lists;
+	std::vector<cv::Mat*> listed; // Every Mat watched this loop
+	std::vector<const uchar*> watchedData; // Data of the Mats watched this loop when the loop began, sorted
+	long long loopStart; // heapAllocations() when the loop began
+	long long lastLoop; // Allocations made by the last loop
+	long long steadyTotal; // Allocations made by every loop after warming up
+	int loops;
+
+	void listWatched();
+};
+
+#endif /* FRAMEARENA_H_ */
@@ -0,0 +1,284 @@
+/*
+ * FrameCache.cpp
+ *
+ *	Source file containing image loading and a least recently used cache of decoded frames, with a background thread that loads
+ *	frames ahead of time.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "FrameCache.h"
+#include <iostream>
+#include <stdio.h>
+
+using namespace cv;
+using namespace std;
+
+/*
+ * Returns the imread flag that decodes an image at the smallest size that is still no smaller than 'scale' times its full size,
+ * and puts the reduction factor used into 'reduction'. JPEG files are then scaled while decoding rather than afterwards.
+ */
+static int reducedDecodeFlag( float scale, int *reduction )
+{
+#if CV_MAJOR_VERSION > 3 || ( CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 2 )
+	if ( scale <= 1.f / 8 ) { *reduction = 8; return IMREAD_REDUCED_COLOR_8; }
+	if ( scale <= 1.f / 4 ) { *reduction = 4; return IMREAD_REDUCED_COLOR_4; }
+	if ( scale <= 1.f / 2 ) { *reduction = 2; return IMREAD_REDUCED_COLOR_2; }
+#else
+	(void)scale;
+#endif
+
+	// Older versions of OpenCV can only decode at full size
+	*reduction = 1;
+	return CV_LOAD_IMAGE_COLOR;
+}
+
+/*
+ * Loads an image from file into 'dest', flipping it the right way up and scaling it by 'scale'. Returns false if the file could
+ * not be read.
+ *
+ * The image is decoded at a reduced size where possible, then flipped and resized to its final size in a single warp that writes
+ * straight into 'dest', so a buffer that is already the right size is reused.
+ */
+bool loadImage( const char *fileName, Mat *dest, float scale )
+{
+	int reduction;
+	Mat image = imread( fileName, reducedDecodeFlag( scale, &reduction ) );
+	if ( image.cols == 0 ) {
+		cout << "Error reading file " << fileName << endl;
+		return false;
+	}
+
+	// Size the image would have been scaled to from full size
+	Size target( cvRound( image.cols * reduction * scale ), cvRound( image.rows * reduction * scale ) );
+
+	if ( target == image.size() )
+	{
+		flip( image, *dest, 0 ); // Silly me took pictures upside down
+		return true;
+	}
+
+	/*
+	 * Flip and resize together, mapping pixel centres:
+	 * 		x' = sx * (x + 0.5) - 0.5
+	 * 		y' = height' - sy * (y + 0.5) - 0.5
+	 */
+	double sx = (double)target.width / image.cols;
+	double sy = (double)target.height / image.rows;
+	Mat warp = (Mat_<double>(2, 3) << sx, 0, 0.5 * sx - 0.5,
+	                                   0, -sy, target.height - 0.5 * sy - 0.5);
+
+	warpAffine( image, *dest, warp, target, INTER_LINEAR, BORDER_REPLICATE );
+	return true;
+}
+
+// ===================================================
+// 				FRAME CACHE CLASS
+// ===================================================
+
+/*
+ *	Constructor for FrameCache class that allows input of how many frames are kept. The background loader is only started by the
+ *	first prefetch, so a cache that is never asked to prefetch never starts a thread.
+ */
+FrameCache::FrameCache( size_t capacity ) : capacity( capacity ), stopping( false ) { }
+
+/*
+ *	Stops the background loader, dropping any frames that have not been loaded yet
+ */
+FrameCache::~FrameCache()
+{
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		stopping = true;
+		requests.clear();
+	}
+
+	changed.notify_all();
+	if ( loader.joinable() ) loader.join();
+}
+
+// ============= Functions
+/*
+ * Puts the frame from 'fileName' scaled by 'scale' into 'dest', loading it if it is not already cached. If the background loader is
+ * already decoding the same frame, this waits for it rather than decoding it twice. The frame is shared with the cache, so it must
+ * be copied before being drawn on. Returns false if the file could not be read.
+ *
+ * A frame that is not cached is decoded straight into 'dest', reusing its buffer, unless that buffer holds another cached frame.
+ */
+bool FrameCache::get( const char *fileName, float scale, Mat *dest )
+{
+	// Kept from call to call so that looking up a cached frame does not allocate
+	static thread_local string key;
+	makeKey( fileName, scale, &key );
+
+	{
+		std::unique_lock<std::mutex> guard( lock );
+
+		// Wait for any thread already loading this frame
+		while ( loading.count( key ) != 0 )
+			changed.wait( guard );
+
+		if ( find( key, dest ) )
+			return true;
+
+		loading.insert( key );
+
+		// Decoding over a frame the cache still holds would change it, so let go of it instead
+		if ( holds( *dest ) )
+			dest->release();
+	}
+
+	bool loaded = loadImage( fileName, dest, scale );
+
+	{
+		std::lock_guard<std::mutex> guard( lock );
+
+		loading.erase( key );
+		if ( loaded ) insert( key, *dest );
+	}
+
+	changed.notify_all();
+	return loaded;
+}
+
+/*
+ * Asks the background loader to load the frame from 'fileName' scaled by 'scale', unless it is already cached or being loaded. The
+ * loader is started if this is the first request.
+ */
+void FrameCache::prefetch( const char *fileName, float scale )
+{
+	string key;
+	makeKey( fileName, scale, &key );
+
+	{
+		std::lock_guard<std::mutex> guard( lock );
+
+		if ( index.count( key ) != 0 || loading.count( key ) != 0 )
+			return;
+
+		Request request;
+		request.fileName = fileName;
+		request.scale = scale;
+		requests.push_back( request );
+
+		if ( !loader.joinable() )
+			loader = std::thread( &FrameCache::runLoader, this );
+	}
+
+	changed.notify_all();
+}
+
+/*
+ * Removes every frame from the cache and forgets any frames waiting to be prefetched
+ */
+void FrameCache::clear()
+{
+	std::lock_guard<std::mutex> guard( lock );
+
+	entries.clear();
+	index.clear();
+	requests.clear();
+}
+
+/*
+ * Puts into 'key' the key a frame is stored under, made from its file name and the preprocessing applied to it. The string's
+ * storage is reused, so a key no longer than the last one does not allocate.
+ */
+void FrameCache::makeKey( const char *fileName, float scale, string *key )
+{
+	char suffix[32];
+	snprintf( suffix, sizeof( suffix ), "|flip|%g", scale );
+
+	key->assign( fileName );
+	key->append( suffix );
+}
+
+/*
+ * Looks up 'key', marking it as most recently used and putting its frame into 'dest'. The lock must be held.
+ */
+bool FrameCache::find( const string &key, Mat *dest )
+{
+	map<string, list<Entry>::iterator>::iterator found = index.find( key );
+
+	if ( found == index.end() )
+		return false;
+
+	entries.splice( entries.begin(), entries, found->second );
+	*dest = found->second->frame;
+	return true;
+}
+
+/*
+ * Returns true if 'frame' shares its data with any cached frame. The lock must be held.
+ */
+bool FrameCache::holds( const Mat &frame ) const
+{
+	if ( frame.empty() )
+		return false;
+
+	for ( list<Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it )
+		if ( it->frame.datastart == frame.datastart )
+			return true;
+
+	return false;
+}
+
+/*
+ * Adds a frame as most recently used, dropping the least recently used frame if the cache is full. The lock must be held.
+ */
+void FrameCache::insert( const string &key, const Mat &frame )
+{
+	if ( index.count( key ) != 0 )
+		return;
+
+	Entry entry;
+	entry.key = key;
+	entry.frame = frame;
+	entries.push_front( entry );
+	index[key] = entries.begin();
+
+	while ( entries.size() > capacity )
+	{
+		index.erase( entries.back().key );
+		entries.pop_back();
+	}
+}
+
+/*
+ * Loop run by the background loader. Loads requested frames one at a time until the cache is destroyed.
+ */
+void FrameCache::runLoader()
+{
+	std::unique_lock<std::mutex> guard( lock );
+
+	while ( !stopping )
+	{
+		if ( requests.empty() )
+		{
+			changed.wait( guard );
+			continue;
+		}
+
+		Request request = requests.front();
+		requests.pop_front();
+
+		string key;
+		makeKey( request.fileName.c_str(), request.scale, &key );
+		if ( index.count( key ) != 0 || loading.count( key ) != 0 )
+			continue;
+
+		loading.insert( key );
+
+		// Decode without holding the lock so the tracking loop is never blocked by it
+		guard.unlock();
+		Mat frame;
+		bool loaded = loadImage( request.fileName.c_str(), &frame, request.scale );
+		guard.lock();
+
+		loading.erase( key );
+		if ( loaded ) insert( key, frame );
+
+		changed.notify_all();
+	}
+}
@@ -0,0 +1,72 @@
+/*
+ * FrameCache.h
+ *
+ * Header file for loading still images and for a cache of decoded frames. Frames are kept after they have been decoded, flipped
+ * and scaled, so an image that is shown again and again only has to be read from disk once. A background thread can load frames
+ * that are likely to be wanted next before they are asked for.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#ifndef FRAMECACHE_H_
+#define FRAMECACHE_H_
+
+bool loadImage( const char*, cv::Mat*, float );
+
+class FrameCache {
+public:
+	// Constructors
+	FrameCache( size_t capacity = 32 );
+	~FrameCache();
+
+	// Functions
+	bool get( const char*, float, cv::Mat* );
+	void prefetch( const char*, float );
+	void clear();
+
+private:
+	// A decoded frame and the key it is stored under
+	struct Entry
+	{
+		std::string key;
+		cv::Mat frame;
+	};
+
+	// A frame waiting to be loaded by the background thread
+	struct Request
+	{
+		std::string fileName;
+		float scale;
+	};
+
+	size_t capacity;
+	std::list<Entry> entries; // Most recently used at the front
+	std::map<std::string, std::list<Entry>::iterator> index;
+	std::set<std::string> loading; // Keys currently being decoded by any thread
+	std::deque<Request> requests;
+
+	std::mutex lock;
+	std::condition_variable changed;
+	std::thread loader;
+	bool stopping;
+
+	static void makeKey( const char*, float, std::string* );
+	bool find( const std::string&, cv::Mat* );
+	bool holds( const cv::Mat& ) const;
+	void insert( const std::string&, const cv::Mat& );
+	void runLoader();
+};
+
+#endif /* FRAMECACHE_H_ */
@@ -0,0 +1,361 @@
+/*
+ * FramePipeline.cpp
+ *
+ *	Source file containing the lock free frame rings and the capture and processing threads of the frame pipeline.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "FramePipeline.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace cv;
+using namespace std;
+
+// ================================= Variables ================================= //
+
+// How long a blocked stage sleeps before looking at its ring again
+const std::chrono::microseconds blockedWait( 200 );
+
+// Weight of the newest frame in the mean latency
+const double latencySmoothing = 0.05;
+
+// Value of FrameRing::taking when the reader is not swapping a frame out
+const size_t noFrame = (size_t)-1;
+
+// ================================= End Variables ================================= //
+
+// ===================================================
+// 				FRAME RING CLASS
+// ===================================================
+
+/*
+ *	Constructor for FrameRing class that allows input of how many frames it holds
+ */
+FrameRing::FrameRing( size_t capacity ) : slots( capacity ), readCount( 0 ), writeCount( 0 ), taking( noFrame ) { }
+
+FrameRing::~FrameRing() { }
+
+// ============= Functions
+/*
+ * Returns the frame to write next. If the ring is full, this returns NULL when 'dropped' is not given; otherwise the oldest frame
+ * waiting is dropped to make room, and 'dropped' is set to the number of frames dropped. Only the writing thread may call this.
+ */
+PipelineFrame* FrameRing::beginWrite( int *dropped )
+{
+	size_t written = writeCount.load( std::memory_order_relaxed );
+	size_t read = readCount.load();
+
+	if ( dropped ) *dropped = 0;
+
+	if ( written - read == slots.size() )
+	{
+		if ( !dropped )
+			return NULL;
+
+		// If the reader takes this frame first, that makes room just the same
+		if ( readCount.compare_exchange_strong( read, read + 1 ) )
+			*dropped = 1;
+	}
+
+	// The reader may have claimed the frame in this slot and still be swapping it out, which takes no time at all
+	while ( written >= slots.size() && taking.load() == written - slots.size() )
+		std::this_thread::yield();
+
+	return &slots[ written % slots.size() ];
+}
+
+/*
+ * Hands the frame from beginWrite on to the reader
+ */
+void FrameRing::endWrite()
+{
+	writeCount.store( writeCount.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+/*
+ * Takes the oldest frame not yet read out of the ring by swapping it with 'dest', whose buffers then go back into the ring to be
+ * written over. Returns false if the ring is empty. Only the reading thread may call this.
+ *
+ * The frame is claimed before it is touched, and the writer waits for a claimed frame to be swapped out before writing its slot.
+ */
+bool FrameRing::read( PipelineFrame *dest )
+{
+	size_t read = readCount.load();
+
+	for ( ;; )
+	{
+		if ( read == writeCount.load() )
+			return false;
+
+		taking.store( read );
+		if ( readCount.compare_exchange_strong( read, read + 1 ) )
+			break;
+
+		// The writer dropped this frame first; 'read' now holds the next one
+		taking.store( noFrame );
+	}
+
+	PipelineFrame &slot = slots[ read % slots.size() ];
+	std::swap( dest->image, slot.image );
+	dest->spots.swap( slot.spots );
+	dest->index = slot.index;
+	dest->captureTicks = slot.captureTicks;
+
+	taking.store( noFrame );
+	return true;
+}
+
+/*
+ * Drops every frame waiting to be read except the newest, and returns how many were dropped. Only the reading thread may call this.
+ */
+int FrameRing::skipToLatest()
+{
+	size_t read = readCount.load();
+	size_t written;
+
+	do
+	{
+		written = writeCount.load();
+
+		if ( written - read <= 1 )
+			return 0;
+	}
+	while ( !readCount.compare_exchange_weak( read, written - 1 ) );
+
+	return (int)( written - 1 - read );
+}
+
+// ===================================================
+// 				FRAME PIPELINE CLASS
+// ===================================================
+
+/*
+ *	Constructor for FramePipeline class. Frames are read from 'videoCapture' and tracked by 'spotTracker' by difference ('d') or by
+ *	colour ('c'). 'policy' is a DropPolicy, and 'showFrames' says whether marked up frames are kept for the main thread to display.
+ */
+FramePipeline::FramePipeline( VideoCapture *videoCapture, SpotTracker *spotTracker, char trackMode, int policy, bool showFrames,
+                              size_t ringSize )
+	: captured( ringSize ), results( ringSize ), stopping( false ), captureDone( false ), processDone( false )
+{
+	capture = videoCapture;
+	tracker = spotTracker;
+	mode = trackMode;
+	dropPolicy = policy;
+	display = showFrames;
+
+	displayInterval = 1000.0 / 60;
+	lastDisplayTicks = 0;
+
+	counts.captured = counts.processed = counts.displayed = counts.dropped = 0;
+	counts.lastLatency = counts.meanLatency = counts.maxLatency = 0;
+}
+
+/*
+ *	Stops the pipeline if it is still running
+ */
+FramePipeline::~FramePipeline()
+{
+	stop();
+}
+
+// ============= Functions
+/*
+ * Starts the capture and processing threads
+ */
+void FramePipeline::start()
+{
+	tracker->resetStream();
+
+	captureThread = std::thread( &FramePipeline::runCapture, this );
+	processThread = std::thread( &FramePipeline::runProcess, this );
+}
+
+/*
+ * Stops both threads, dropping any frames still in the pipeline
+ */
+void FramePipeline::stop()
+{
+	stopping = true;
+
+	if ( captureThread.joinable() ) captureThread.join();
+	if ( processThread.joinable() ) processThread.join();
+}
+
+/*
+ * Returns true once the capture has run out of frames and every frame captured has been processed
+ */
+bool FramePipeline::finished() const
+{
+	return processDone;
+}
+
+/*
+ * Returns the newest marked up frame if it is time to show another, otherwise NULL. Frames are never shown closer together than
+ * 'displayInterval'. With latest wins, older frames waiting to be shown are dropped. Call doneDisplaying after showing the frame.
+ */
+PipelineFrame* FramePipeline::nextDisplayFrame()
+{
+	if ( ( getTickCount() - lastDisplayTicks ) * 1000.0 / getTickFrequency() < displayInterval )
+		return NULL;
+
+	if ( dropPolicy == DROP_LATEST_WINS )
+		countDropped( results.skipToLatest() );
+
+	if ( !results.read( &displaying ) )
+		return NULL;
+
+	lastDisplayTicks = getTickCount();
+	return &displaying;
+}
+
+/*
+ * Counts the frame from nextDisplayFrame as shown
+ */
+void FramePipeline::doneDisplaying()
+{
+	std::lock_guard<std::mutex> guard( statsLock );
+	counts.displayed++;
+}
+
+/*
+ * Returns a copy of the counts and latencies so far
+ */
+PipelineStats FramePipeline::stats()
+{
+	std::lock_guard<std::mutex> guard( statsLock );
+	return counts;
+}
+
+/*
+ * Loop run by the capture thread. Each frame is read straight into a frame of the capture ring and scaled there. If the ring is
+ * full, latest wins drops the oldest frame waiting to make room, while block waits for the processing thread. The capture time is
+ * taken before reading, so the latency includes decoding and scaling the frame.
+ */
+void FramePipeline::runCapture()
+{
+	long index = 0;
+	float scale = tracker->params.frameScale;
+
+	while ( !stopping )
+	{
+		int dropped = 0;
+		PipelineFrame *frame = captured.beginWrite( dropPolicy == DROP_LATEST_WINS ? &dropped : NULL );
+
+		if ( !frame )
+		{
+			std::this_thread::sleep_for( blockedWait );
+			continue;
+		}
+
+		countDropped( dropped );
+
+		int64 captureTicks = getTickCount();
+		if ( !capture->read( rawFrame ) ) break;
+
+		if ( scale == 1 )
+			rawFrame.copyTo( frame->image );
+		else
+			resize( rawFrame, frame->image, Size(), scale, scale );
+
+		frame->index = index++;
+		frame->captureTicks = captureTicks;
+		captured.endWrite();
+
+		std::lock_guard<std::mutex> guard( statsLock );
+		counts.captured++;
+	}
+
+	captureDone = true;
+}
+
+/*
+ * Loop run by the processing thread. Frames are tracked in turn, or with latest wins when tracking by colour only the newest
+ * waiting frame is, and the latency from capture to spots is recorded. Tracking by difference pairs frames with the ones before
+ * them, so it never skips; frames dropped at capture are known from their numbers. If display is wanted, the frame is marked up
+ * into a frame of the result ring.
+ */
+void FramePipeline::runProcess()
+{
+	while ( !stopping )
+	{
+		if ( dropPolicy == DROP_LATEST_WINS && mode != 'd' )
+			countDropped( captured.skipToLatest() );
+
+		if ( !captured.read( &processing ) )
+		{
+			// Once capture has finished, look once more for a last frame put in after the ring was looked at
+			if ( !captureDone )
+			{
+				std::this_thread::sleep_for( blockedWait );
+				continue;
+			}
+
+			if ( !captured.read( &processing ) ) break;
+		}
+
+		bool tracked = true;
+
+		if ( mode == 'd' )
+			tracked = tracker->trackStreamFrame( processing.image, processing.captureTicks * 1000.0 / getTickFrequency(),
+			                                     processing.index );
+		else
+			tracker->trackByColour( processing.image );
+
+		long index = processing.index;
+		int64 captureTicks = processing.captureTicks;
+
+		// The first frame of a difference pair has no spots of its own
+		if ( !tracked )
+			continue;
+
+		double latency = ( getTickCount() - captureTicks ) * 1000.0 / getTickFrequency();
+
+		{
+			std::lock_guard<std::mutex> guard( statsLock );
+			counts.processed++;
+			counts.lastLatency = latency;
+			counts.meanLatency = ( counts.processed == 1 ? latency : counts.meanLatency + latencySmoothing * ( latency - counts.meanLatency ) );
+			counts.maxLatency = std::max( counts.maxLatency, latency );
+		}
+
+		if ( !display )
+			continue;
+
+		int dropped = 0;
+		PipelineFrame *result = results.beginWrite( dropPolicy == DROP_LATEST_WINS ? &dropped : NULL );
+
+		while ( !result && !stopping )
+		{
+			std::this_thread::sleep_for( blockedWait );
+			result = results.beginWrite();
+		}
+
+		if ( !result )
+			continue;
+
+		countDropped( dropped );
+
+		( mode == 'd' ? tracker->nextFrame : tracker->frame ).copyTo( result->image );
+		tracker->drawSpots( &result->image );
+		result->spots = tracker->spots;
+		result->index = index;
+		result->captureTicks = captureTicks;
+		results.endWrite();
+	}
+
+	processDone = true;
+}
+
+/*
+ * Adds 'dropped' frames to the count of frames dropped
+ */
+void FramePipeline::countDropped( int dropped )
+{
+	if ( dropped == 0 ) return;
+
+	std::lock_guard<std::mutex> guard( statsLock );
+	counts.dropped += dropped;
+}
@@ -0,0 +1,116 @@
+/*
+ * FramePipeline.h
+ *
+ * Header file for a threaded capture / process / display pipeline. Capture and processing each run on their own thread, handing
+ * frames on through bounded single producer, single consumer rings whose frame buffers are reused, so a slow frame never holds up
+ * the camera. Display is left to the main thread, as the windows must be drawn there.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "SpotTracker.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef FRAMEPIPELINE_H_
+#define FRAMEPIPELINE_H_
+
+/*
+ * What a stage does when the ring it hands frames on to is full
+ */
+enum DropPolicy
+{
+	DROP_LATEST_WINS, // Drop frames so that the next stage always gets the newest one
+	DROP_BLOCK // Wait, so that every frame is processed
+};
+
+/*
+ * A frame moving through the pipeline
+ */
+typedef struct PipelineFrame
+{
+	cv::Mat image;
+	long index; // Number of the frame since capture started
+	int64 captureTicks; // Tick count when the frame was captured
+	std::vector<Spot> spots;
+} PipelineFrame;
+
+/*
+ * A bounded ring of frames with one thread writing and one thread reading, and no locks. The frames stay in the ring and are
+ * written over in place, so their buffers are reused. A frame is read by swapping it out for the reader's own frame, so the reader
+ * never holds a slot and a writer that finds the ring full can drop the oldest frame waiting instead of the newest.
+ */
+class FrameRing {
+public:
+	// Constructors
+	FrameRing( size_t );
+	~FrameRing();
+
+	// Functions
+	PipelineFrame* beginWrite( int *dropped = NULL );
+	void endWrite();
+	bool read( PipelineFrame* );
+	int skipToLatest();
+
+private:
+	std::vector<PipelineFrame> slots;
+	std::atomic<size_t> readCount; // Frames read or dropped so far; changed by the reader, and by the writer when it drops
+	std::atomic<size_t> writeCount; // Frames written so far; only changed by the writer
+	std::atomic<size_t> taking; // Number of the frame the reader is swapping out, or 'noFrame'
+};
+
+/*
+ * Counts kept by the pipeline. Latencies are from capture to the spots being found, in milliseconds.
+ */
+typedef struct PipelineStats
+{
+	long captured, processed, displayed, dropped;
+	double lastLatency, meanLatency, maxLatency;
+} PipelineStats;
+
+class FramePipeline {
+public:
+	// Variables
+	double displayInterval; // Shortest time between frames shown, in milliseconds, so display keeps to the screen refresh rate
+
+	// Constructors
+	FramePipeline( cv::VideoCapture*, SpotTracker*, char, int, bool, size_t ringSize = 4 );
+	~FramePipeline();
+
+	// Functions
+	void start();
+	void stop();
+	bool finished() const;
+	PipelineFrame* nextDisplayFrame();
+	void doneDisplaying();
+	PipelineStats stats();
+
+private:
+	cv::VideoCapture *capture;
+	SpotTracker *tracker;
+	char mode; // 'd' to track by difference, 'c' by colour
+	int dropPolicy;
+	bool display;
+
+	FrameRing captured, results;
+	PipelineFrame processing, displaying; // Frames taken out of the rings by the processing and main threads
+	cv::Mat rawFrame;
+	int64 lastDisplayTicks;
+
+	std::thread captureThread, processThread;
+	std::atomic<bool> stopping, captureDone, processDone;
+
+	std::mutex statsLock;
+	PipelineStats counts;
+
+	void runCapture();
+	void runProcess();
+	void countDropped( int );
+};
+
+#endif /* FRAMEPIPELINE_H_ */
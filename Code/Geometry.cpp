@@ -6,22 +6,44 @@
  */
 
 #include "Geometry.h"
+#include "RayBatch.h"
+#include "Rotation.h"
+#include "Triangulation.h"
+#include "Correspondence.h"
 #include <math.h>
+#include <stdlib.h>
 #include <cmath>
 using std::abs;
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 using std::cout;
 using std::cin;
 using std::endl;
+#include <vector>
+using std::vector;
 
 #define PI 3.14159265
 #define min 0.0000001
 
+// Rotations built from constants are worked out by the compiler, in float and in fixed point alike
+constexpr Matrix3D quarterYaw = Matrix3D::yaw( 0, 1 );
+static_assert( quarterYaw * Vector3D( 1, 0, 0 ) == Vector3D( 0, 1, 0 ), "A quarter turn of yaw takes x to y" );
+static_assert( Matrix3Fixed::roll( 0, 1 ) * Matrix3Fixed::roll( 0, 1 ) * Vector3Fixed( 0, 1, 0 ) == Vector3Fixed( 0, -1, 0 ),
+               "Two quarter turns of roll take y to -y" );
+
 
 void runGeometryCalculations()
 {
 	testReflection();
 	testRotation();
+	testRayBatch();
+	testTriangulation();
+
+	float worstRight;
+	bool matched = testCorrespondence( 0.95f, 64, &worstRight );
+	cout << "Correspondence index " << ( matched ? "is" : "is NOT" ) << " within thresholds: worst " << worstRight * 100
+	     << "% of spots matched right" << endl;
 }
 
 /*
@@ -85,243 +107,126 @@ void testRotation()
 	angles.p.y = angles.p.y * PI / 180;
 	angles.p.z = angles.p.z * PI / 180;
 
-	// Rotate vector about each axis by specified angle
-	rotated = normal;
-	if ( abs(angles.p.x) > min ) rotated = rotated.rotateRoll( angles.p.x );
-	if ( abs(angles.p.y) > min ) rotated = rotated.rotatePitch( angles.p.y );
-	if ( abs(angles.p.z) > min ) rotated = rotated.rotateYaw( angles.p.z );
-
-	// Print result
-	cout << "Rotated Vector: \n";
-	cout << "R  = \t"; rotated.print(); cout << endl;
-	cout << "Rn = \t"; rotated.getNormalized().print(); cout << endl;
-}
-
-
-// ===================================================
-// 				VECTOR CLASS
-// ===================================================
-
-/*
- *	Default Constructor whereby vector parameters are 0
- */
-Vector3D::Vector3D()
-{
-	p.x = 0; p.y = 0; p.z = 0;
-}
-
-/*
- *	Constructor for Vector3D class that allows input of x, y, z values
- */
-Vector3D::Vector3D( float x, float y, float z )
-{
-	p.x = x; p.y = y; p.z = z;
-}
-
-Vector3D::~Vector3D() { }
-
-// ============= Functions
-/*
- *	Returns dot product of this vector and argument vector 'v'
- */
-float Vector3D::dotProduct( const Vector3D v ) const
-{
-	return (p.x * v.p.x) + (p.y * v.p.y) + (p.z * v.p.z);
-}
-
-/*
- *	Returns cross product of this vector and argument vector 'v'
- */
-Vector3D Vector3D::crossProduct( const Vector3D v ) const
-{
-	float x, y, z;
-
-	// y*q.z-z*q.y, z*q.x-x*q.z, x*q.y-y*q.x
-	x = (p.y * v.p.z) - (p.z * v.p.y);
-	y = (p.z * v.p.x) - (p.x * v.p.z);
-	z = (p.x * v.p.y) - (p.y * v.p.x);
-
-	return Vector3D( x, y, z );
-}
-
-/*
- *	Returns length of this vector
- */
-float Vector3D::length()
-{
-	return sqrtf( (p.x * p.x) + (p.y * p.y) + (p.z * p.z) );
-}
-
-/*
- *	Normalizes this vector (length one)
- */
-void Vector3D::normalize()
-{
-	float l = length();
-
-	p.x = p.x / l;
-	p.y = p.y / l;
-	p.z = p.z / l;
-}
-
-/*
- *	Returns normalized version of this vector (length one)
- */
-Vector3D Vector3D::getNormalized()
-{
-	Vector3D v;
-
-	float l = length();
-
-	v.p.x = p.x / l;
-	v.p.y = p.y / l;
-	v.p.z = p.z / l;
-
-	return v;
-}
-
-/*
- *	Returns this vector reflected about vector 'normal'
- */
-Vector3D Vector3D::reflect(Vector3D normal ) const
-{
-	Vector3D r;
-
-	normal.normalize();
-
-	float dot = this->dotProduct(normal);
-
-	// NORMAL VECTOR MUST BE NORMALIZED
-	// r = v - (2 * ( v dot normal ) * n)
-	r = *this - ((normal * dot) * 2.f);
-
-	return r;
-}
-
-/*
- *  Rotate vector around Z axis (yaw) and return resulting Vector
- */
-Vector3D Vector3D::rotateYaw( float theta ) // RADIANS
-{
-	/*
-	 * Rotation Matrix :[ cos(t),-sin(t), 0 ] [ x ]
-	 * 					[ sin(t), cos(t), 0 ] [ y ]
-	 * 					[ 0 	, 0 	, 1 ] [ z ]
-	 *
-	 */
-
-	Vector3D rotated;
-
-	rotated.p.x = (p.x * cos(theta)) + (p.y * -sin(theta)) + (p.z * 0);
-	rotated.p.y = (p.x * sin(theta)) + (p.y * cos(theta)) + (p.z * 0);
-	rotated.p.z = (p.x * 0) + (p.y * 0) + (p.z * 1);
+	// Build the rotation about each axis by specified angle once, then rotate the vector with no trigonometry
+	Rotation rotation( angles.p.x, angles.p.y, angles.p.z );
+	rotated = rotation.apply( normal );
 
 	if ( abs(rotated.p.x) < min ) rotated.p.x = 0;
 	if ( abs(rotated.p.y) < min ) rotated.p.y = 0;
 	if ( abs(rotated.p.z) < min ) rotated.p.z = 0;
 
-	return rotated;
-}
-
-/*
- *  Rotate vector around X axis (pitch) and return resulting Vector
- */
-Vector3D Vector3D::rotateRoll( float theta ) // RADIANS
-{
-	/*
-	 * Rotation Matrix :[ 1, 	  0, 	  0 ] [ x ]
-	 * 					[ 0, cos(t),-sin(t) ] [ y ]
-	 * 					[-0, sin(t), cos(t) ] [ z ]
-	 *
-	 */
-
-	Vector3D rotated;
-
-	rotated.p.x = (p.x * 1) + (p.y * 0) + (p.z * 0);
-	rotated.p.y = (p.x * 0) + (p.y * cos(theta)) + (p.z * -sin(theta));
-	rotated.p.z = (p.x * 0) + (p.y * sin(theta)) + (p.z * cos(theta));
-
-	if ( abs(rotated.p.x) < min ) rotated.p.x = 0;
-	if ( abs(rotated.p.y) < min ) rotated.p.y = 0;
-	if ( abs(rotated.p.z) < min ) rotated.p.z = 0;
-
-	return rotated;
-}
-
-/*
- *  Rotate vector around Y axis (roll) and return resulting Vector
- */
-Vector3D Vector3D::rotatePitch( float theta ) // RADIANS
-{
-	/*
-	 * Rotation Matrix :[ cos(t), 0, sin(t) ] [ x ]
-	 * 					[ 0     , 1, 0      ] [ y ]
-	 * 					[-sin(t), 0, cos(t) ] [ z ]
-	 *
-	 */
-
-	Vector3D rotated;
-
-	rotated.p.x = (p.x * cos(theta)) + (p.y * 0) + (p.z * sin(theta));
-	rotated.p.y = (p.x * 0) + (p.y * 1) + (p.z * 0);
-	rotated.p.z = (p.x * -sin(theta)) + (p.y * 0) + (p.z * cos(theta));
-
-	if ( abs(rotated.p.x) < min ) rotated.p.x = 0;
-	if ( abs(rotated.p.y) < min ) rotated.p.y = 0;
-	if ( abs(rotated.p.z) < min ) rotated.p.z = 0;
-
-	return rotated;
+	// Print result
+	cout << "Rotation: \n"; rotation.print();
+	cout << "Q  = \t"; rotation.q.print(); cout << endl;
+	cout << "Rotated Vector: \n";
+	cout << "R  = \t"; rotated.print(); cout << endl;
+	cout << "Rn = \t"; rotated.getNormalized().print(); cout << endl;
 }
 
 /*
- *	Print out vector parameters to console
- */
-void Vector3D::print()
-{
-	cout << "(" << p.x << ", " << p.y << ", " << p.z << ")";
-}
-
-
-// =================================================== Operators
-
-
-Vector3D Vector3D::operator-()
-{
-	return Vector3D( -p.x, -p.y, -p.z );
-}
-
-Vector3D Vector3D::operator*( float scale ) const
-{
-	Vector3D v;
-
-	v.p.x = p.x * scale;
-	v.p.y = p.y * scale;
-	v.p.z = p.z * scale;
-
-	return v;//Vector( p.x * scale, p.y * scale, p.z * scale );
-}
-
-Vector3D Vector3D::operator/( float scale ) const
-{
-	return Vector3D( p.x / scale, p.y / scale, p.z / scale );
-}
-
-Vector3D Vector3D::operator-( const Vector3D v ) const
-{
-	return Vector3D( p.x - v.p.x, p.y - v.p.y, p.z - v.p.z );
-}
-
-Vector3D Vector3D::operator+( const Vector3D v ) const
-{
-	return Vector3D( p.x + v.p.x, p.y + v.p.y, p.z + v.p.z );
-}
-
-bool Vector3D::operator==( const Vector3D v ) const
-{
-	return ( p.x == v.p.x && p.y == v.p.y && p.z == v.p.z );
-}
-
-bool Vector3D::operator!=( const Vector3D v ) const
-{
-	return ( p.x != v.p.x || p.y != v.p.y | p.z != v.p.z );
+ *	Function to test the ray batch kernels against the Vector3D functions, timing both over many random rays
+ */
+void testRayBatch()
+{
+	const int rayCount = 4096;
+	const int repeats = 200;
+	const float theta = 0.3f;
+	Vector3D mirror( 0.3f, -0.2f, 1.f );
+
+	vector<Vector3D> rays( rayCount ), normals( rayCount ), scalar( rayCount );
+	RayBatch batch( rayCount ), normalBatch( rayCount ), result;
+
+	srand( 1 );
+	for ( int i = 0; i < rayCount; i++ )
+	{
+		rays[i] = Vector3D( rand() % 2001 - 1000, rand() % 2001 - 1000, rand() % 2001 - 1000 ) / 100.f;
+		normals[i] = Vector3D( rand() % 2001 - 1000, rand() % 2001 - 1000, rand() % 1000 + 1 ) / 100.f;
+		batch.set( i, rays[i] );
+		normalBatch.set( i, normals[i] );
+	}
+
+	// Largest difference between the batch and scalar results, which should be 0 for reflections
+	float reflectError = 0, rotateError = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for ( int r = 0; r < repeats; r++ )
+		for ( int i = 0; i < rayCount; i++ )
+			scalar[i] = rays[i].reflect( mirror );
+	std::chrono::duration<double, std::micro> scalarTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for ( int r = 0; r < repeats; r++ )
+		reflectRays( batch, mirror, &result );
+	std::chrono::duration<double, std::micro> batchTime = std::chrono::steady_clock::now() - start;
+
+	for ( int i = 0; i < rayCount; i++ )
+	{
+		Vector3D d = result.get( i ) - scalar[i];
+		reflectError = std::max( reflectError, std::max( abs( d.p.x ), std::max( abs( d.p.y ), abs( d.p.z ) ) ) );
+	}
+
+	cout << "Reflect off one mirror: \t" << scalarTime.count() / repeats << " us scalar, " << batchTime.count() / repeats
+	     << " us batch for " << rayCount << " rays" << endl;
+
+	// Each ray off its own mirror
+	start = std::chrono::steady_clock::now();
+	for ( int r = 0; r < repeats; r++ )
+		for ( int i = 0; i < rayCount; i++ )
+			scalar[i] = rays[i].reflect( normals[i] );
+	scalarTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for ( int r = 0; r < repeats; r++ )
+		reflectRays( batch, normalBatch, &result );
+	batchTime = std::chrono::steady_clock::now() - start;
+
+	for ( int i = 0; i < rayCount; i++ )
+	{
+		Vector3D d = result.get( i ) - scalar[i];
+		reflectError = std::max( reflectError, std::max( abs( d.p.x ), std::max( abs( d.p.y ), abs( d.p.z ) ) ) );
+	}
+
+	cout << "Reflect off many mirrors: \t" << scalarTime.count() / repeats << " us scalar, " << batchTime.count() / repeats
+	     << " us batch" << endl;
+
+	// Roll, pitch then yaw
+	start = std::chrono::steady_clock::now();
+	for ( int r = 0; r < repeats; r++ )
+		for ( int i = 0; i < rayCount; i++ )
+			scalar[i] = rays[i].rotateRoll( theta ).rotatePitch( theta ).rotateYaw( theta );
+	scalarTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for ( int r = 0; r < repeats; r++ )
+	{
+		rotateRaysRoll( batch, theta, &result );
+		rotateRaysPitch( result, theta, &result );
+		rotateRaysYaw( result, theta, &result );
+	}
+	batchTime = std::chrono::steady_clock::now() - start;
+
+	for ( int i = 0; i < rayCount; i++ )
+	{
+		Vector3D d = result.get( i ) - scalar[i];
+		rotateError = std::max( rotateError, std::max( abs( d.p.x ), std::max( abs( d.p.y ), abs( d.p.z ) ) ) );
+	}
+
+	// The same three rotations made into one
+	start = std::chrono::steady_clock::now();
+	for ( int r = 0; r < repeats; r++ )
+	{
+		Rotation rotation( theta, theta, theta );
+		rotation.apply( batch, &result );
+	}
+	std::chrono::duration<double, std::micro> rotationTime = std::chrono::steady_clock::now() - start;
+
+	for ( int i = 0; i < rayCount; i++ )
+	{
+		Vector3D d = result.get( i ) - scalar[i];
+		rotateError = std::max( rotateError, std::max( abs( d.p.x ), std::max( abs( d.p.y ), abs( d.p.z ) ) ) );
+	}
+
+	cout << "Rotate: \t\t\t" << scalarTime.count() / repeats << " us scalar, " << batchTime.count() / repeats << " us batch, "
+	     << rotationTime.count() / repeats << " us composed" << endl;
+	cout << "Largest difference: reflect " << reflectError << ", rotate " << rotateError << endl;
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+/*
+ * HeapCounter.cpp
+ *
+ *	Source file containing the counting operator new.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "HeapCounter.h"
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+// ================================= Variables ================================= //
+
+// Calls to operator new, from any thread
+static std::atomic<long long> allocationCount( 0 );
+
+// ================================= End Variables ================================= //
+
+/*
+ * Every allocation made through new is counted before being passed on to malloc
+ */
+void* operator new( size_t size )
+{
+	allocationCount.fetch_add( 1, std::memory_order_relaxed );
+
+	void *p = malloc( size != 0 ? size : 1 );
+	if ( p == NULL )
+		throw std::bad_alloc();
+
+	return p;
+}
+
+void* operator new[]( size_t size )
+{
+	return operator new( size );
+}
+
+void operator delete( void *p ) noexcept
+{
+	free( p );
+}
+
+void operator delete[]( void *p ) noexcept
+{
+	free( p );
+}
+
+long long heapAllocations()
+{
+	return allocationCount.load( std::memory_order_relaxed );
+}
@@ -0,0 +1,19 @@
+/*
+ * HeapCounter.h
+ *
+ * Header file for a count of heap allocations, kept by replacing operator new. It needs nothing but the standard library, so code
+ * that does not use OpenCV, such as the geometry, can check that it has stopped allocating.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#ifndef HEAPCOUNTER_H_
+#define HEAPCOUNTER_H_
+
+/*
+ * Returns how many times operator new has been called since the program started, by any thread
+ */
+long long heapAllocations();
+
+#endif /* HEAPCOUNTER_H_ */
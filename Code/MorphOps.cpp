@@ -8,6 +8,10 @@
  */
 
 #include "MorphOps.h"
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
 
 using namespace cv;
 
@@ -18,23 +22,76 @@ int dilation_size = 2;
 int const max_elem = 2;
 int const max_kernel_size = 21;
 
+// Smallest Gaussian kernel for which the recursive filter is faster than OpenCV's separable convolution
+int const recursive_gaussian_min_size = 15;
+
+/*
+ * A structuring element along with the half width of each of its rows. Every element made by getStructuringElement is a stack of
+ * rows that are each a run of pixels centred on the anchor column, so the half widths describe it completely.
+ */
+struct MorphElement
+{
+	Mat element;
+	std::vector<int> halfWidths; // One per row, -1 where a row is empty
+	bool separable; // Every row has the same half width, as in a rectangle
+};
+
 // ================================= End Variables ================================= //
 
+/*
+ * Converts a kernel type (0 = rectangle, 1 = cross, 2 = ellipse) to an OpenCV morphological shape
+ */
+static int morphShape( int kernelType )
+{
+	if ( kernelType == 1 ) return MORPH_CROSS;
+	if ( kernelType == 2 ) return MORPH_ELLIPSE;
+	return MORPH_RECT;
+}
+
+/*
+ * Returns the structuring element for a kernel type and size. Elements are made once and then kept, so repeated calls with the
+ * same type and size cost a lookup.
+ */
+static const MorphElement& getElement( int kernelType, int kernelSize )
+{
+	static std::map< std::pair<int,int>, MorphElement > elements;
+	static std::mutex elementsLock;
+
+	std::lock_guard<std::mutex> guard( elementsLock );
+	std::pair<int,int> key( morphShape( kernelType ), kernelSize );
+	std::map< std::pair<int,int>, MorphElement >::iterator found = elements.find( key );
+
+	if ( found != elements.end() )
+		return found->second;
+
+	MorphElement &e = elements[key];
+	e.element = getStructuringElement( key.first,
+	                                   Size( 2*kernelSize + 1, 2*kernelSize+1 ),
+	                                   Point( kernelSize, kernelSize ) );
+
+	// Measure the run of pixels in each row
+	e.separable = true;
+	for ( int y = 0; y < e.element.rows; y++ )
+	{
+		const uchar *p = e.element.ptr<uchar>(y);
+		int first = 0;
+
+		while ( first < e.element.cols && p[first] == 0 ) first++;
+
+		e.halfWidths.push_back( first < e.element.cols ? kernelSize - first : -1 );
+		if ( e.halfWidths[y] != e.halfWidths[0] ) e.separable = false;
+	}
+
+	return e;
+}
+
 /*
  * This function will 'erode' and image and get rid of any noise. This will eliminate small high-intensity pixels, make dark
  * areas larger and make bright areas smaller
  */
 void erodeImage( Mat *src, Mat *dest, int kernelType, int kernelSize = 2 )
 {
-	int erosion_type;
-
-	if( kernelType == 0 ){ erosion_type = MORPH_RECT; }
-	else if( kernelType == 1 ){ erosion_type = MORPH_CROSS; }
-	else if( kernelType == 2) { erosion_type = MORPH_ELLIPSE; }
-
-	Mat element = getStructuringElement( erosion_type,
-	                                       Size( 2*kernelSize + 1, 2*kernelSize+1 ),
-	                                       Point( kernelSize, kernelSize ) );
+	const Mat &element = getElement( kernelType, kernelSize ).element;
 
 	// Apply the erosion operation
 	erode( *src, *dest, element );
@@ -45,23 +102,111 @@ void erodeImage( Mat *src, Mat *dest, int kernelType, int kernelSize = 2 )
  */
 void dilateImage( Mat *src, Mat *dest, int kernelType, int kernelSize = 2 )
 {
-	int dilation_type;
-	if( kernelType == 0 ){ dilation_type = MORPH_RECT; }
-	else if( kernelType == 1 ){ dilation_type = MORPH_CROSS; }
-	else if( kernelType == 2) { dilation_type = MORPH_ELLIPSE; }
+	const Mat &element = getElement( kernelType, kernelSize ).element;
 
-	Mat element = getStructuringElement( dilation_type,
-	                                       Size( 2*kernelSize + 1, 2*kernelSize+1 ),
-	                                       Point( kernelSize, kernelSize ) );
 	// Apply the dilation operation
 	dilate( *src, *dest, element );
 }
 
+/*
+ * Runs the forward then backward passes of a third order recursive filter along 'length' values starting at 'p', 'stride' apart.
+ * Values before the start and after the end are taken to equal the first and last values, for which the filter leaves a value
+ * unchanged.
+ */
+static void recursiveLine( float *p, int length, int stride, const float *b )
+{
+	float w1, w2, w3;
+
+	w1 = w2 = w3 = p[0];
+	for ( int i = 0; i < length; i++ )
+	{
+		float w = b[0] * p[i * stride] + b[1] * w1 + b[2] * w2 + b[3] * w3;
+		p[i * stride] = w;
+		w3 = w2; w2 = w1; w1 = w;
+	}
+
+	w1 = w2 = w3 = p[(length - 1) * stride];
+	for ( int i = length - 1; i >= 0; i-- )
+	{
+		float w = b[0] * p[i * stride] + b[1] * w1 + b[2] * w2 + b[3] * w3;
+		p[i * stride] = w;
+		w3 = w2; w2 = w1; w1 = w;
+	}
+}
+
+/*
+ * Applies the recursive Gaussian filter of Young and van Vliet (1995) to 'src'. The cost per pixel is the same for any sigma.
+ * 'floatImage' holds the float copy of 'src' that is filtered, so a caller that keeps it reuses it from call to call.
+ *
+ * Rows are filtered one at a time; columns are filtered a whole row at a time so that memory is read in order.
+ */
+static void recursiveGaussian( const Mat &src, Mat *dest, double sigma, Mat *floatImage )
+{
+	double q = ( sigma >= 2.5 ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * sqrt( 1 - 0.26891 * sigma ) );
+	double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+	double b1 = 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q;
+	double b2 = -( 1.4281 * q * q + 1.26661 * q * q * q );
+	double b3 = 0.422205 * q * q * q;
+
+	// Weights of the new value and of the last three outputs
+	const float b[4] = { (float)( 1 - ( b1 + b2 + b3 ) / b0 ), (float)( b1 / b0 ), (float)( b2 / b0 ), (float)( b3 / b0 ) };
+
+	Mat &image = *floatImage;
+	src.convertTo( image, CV_32F );
+
+	const int channels = image.channels();
+	const int width = image.cols * channels;
+
+	// Along each row, one channel at a time
+	for ( int y = 0; y < image.rows; y++ )
+	{
+		float *p = image.ptr<float>(y);
+
+		for ( int c = 0; c < channels; c++ )
+			recursiveLine( p + c, image.cols, channels, b );
+	}
+
+	// Down the columns, forwards then backwards. Rows off the edge repeat the edge row, which the filter leaves unchanged.
+	for ( int y = 0; y < image.rows; y++ )
+	{
+		float *p = image.ptr<float>(y);
+		const float *p1 = image.ptr<float>( std::max( y - 1, 0 ) );
+		const float *p2 = image.ptr<float>( std::max( y - 2, 0 ) );
+		const float *p3 = image.ptr<float>( std::max( y - 3, 0 ) );
+
+		for ( int x = 0; x < width; x++ )
+			p[x] = b[0] * p[x] + b[1] * p1[x] + b[2] * p2[x] + b[3] * p3[x];
+	}
+
+	for ( int y = image.rows - 1; y >= 0; y-- )
+	{
+		float *p = image.ptr<float>(y);
+		const float *p1 = image.ptr<float>( std::min( y + 1, image.rows - 1 ) );
+		const float *p2 = image.ptr<float>( std::min( y + 2, image.rows - 1 ) );
+		const float *p3 = image.ptr<float>( std::min( y + 3, image.rows - 1 ) );
+
+		for ( int x = 0; x < width; x++ )
+			p[x] = b[0] * p[x] + b[1] * p1[x] + b[2] * p2[x] + b[3] * p3[x];
+	}
+
+	image.convertTo( *dest, src.depth() );
+}
+
 /*
  * This function will blur and image by blending the value of each pixel based on the sum of each
+ *
+ * Every blur here costs the same per pixel whatever the kernel size: OpenCV's box filter keeps running sums, its median filter uses
+ * constant time histograms for 8 bit images with kernels larger than 5, and large Gaussian kernels use a recursive filter instead of
+ * a convolution. Small Gaussian kernels keep the exact convolution, which is faster there.
+ *
+ * The recursive Gaussian and the median of images that are not 8 bit work in a temporary image. It is put in 'scratch' if given,
+ * so a caller that blurs every frame can keep it.
  */
-void blurImage( Mat *src, Mat *dest, int blurType, int kernelSize = 2 )
+void blurImage( Mat *src, Mat *dest, int blurType, int kernelSize = 2, Mat *scratch )
 {
+	Mat local;
+	Mat &work = ( scratch ? *scratch : local );
+
 	/*
 	 * 0 = Homogeneous
 	 * 1 = Gaussian
@@ -75,14 +220,401 @@ void blurImage( Mat *src, Mat *dest, int blurType, int kernelSize = 2 )
 		blur( *src, *dest, Size( kernelSize, kernelSize ), Point(-1,-1) );
 		break;
 	case 1:
-		GaussianBlur( *src, *dest, Size( kernelSize, kernelSize ), 0, 0 );
+		if ( kernelSize >= recursive_gaussian_min_size )
+			recursiveGaussian( *src, dest, 0.3 * ( ( kernelSize - 1 ) * 0.5 - 1 ) + 0.8, &work ); // Same sigma as GaussianBlur uses
+		else
+			GaussianBlur( *src, *dest, Size( kernelSize, kernelSize ), 0, 0 );
 		break;
 	case 2:
-		medianBlur( *src, *dest, kernelSize );
+		// Kernels larger than 5 are only supported by OpenCV for 8 bit images. The median keeps the order of values, so the image's
+		// own range is stretched over 8 bits and back, which only rounds each value to one of 256 levels of that range.
+		if ( kernelSize > 5 && src->depth() != CV_8U )
+		{
+			double low, high;
+			minMaxLoc( src->reshape( 1 ), &low, &high );
+			double step = ( high > low ? ( high - low ) / 255 : 1 );
+
+			src->convertTo( work, CV_8U, 1 / step, -low / step );
+			medianBlur( work, work, kernelSize );
+			work.convertTo( *dest, src->depth(), step, low );
+		}
+		else
+		{
+			medianBlur( *src, *dest, kernelSize );
+		}
 		break;
 	}
 }
 
 
+// ===================================================
+// 				BINARY MORPHOLOGY
+// ===================================================
+
+/*
+ * Sets the bits past the last pixel of a row to 'fill', so they read the same as pixels outside the image
+ */
+static void setRowTail( uint64_t *row, int cols, int words, uint64_t fill )
+{
+	int used = cols & 63;
 
+	if ( used != 0 )
+	{
+		uint64_t keep = ( (uint64_t)1 << used ) - 1;
+		row[words - 1] = ( row[words - 1] & keep ) | ( fill & ~keep );
+	}
+}
 
+/*
+ * Puts 'src' moved by 'offset' pixels into 'dst', so that dst[x] = src[x + offset]. Pixels read from outside 'src' are 'fill'. The
+ * two rows may have different lengths but must not overlap.
+ */
+static void shiftRow( const uint64_t *src, int srcWords, uint64_t *dst, int dstWords, int offset, uint64_t fill )
+{
+	if ( offset >= 0 )
+	{
+		int q = offset >> 6, r = offset & 63;
+
+		for ( int i = 0; i < dstWords; i++ )
+		{
+			uint64_t lo = ( i + q < srcWords ? src[i + q] : fill );
+			uint64_t hi = ( i + q + 1 < srcWords ? src[i + q + 1] : fill );
+			dst[i] = ( r == 0 ? lo : (lo >> r) | (hi << (64 - r)) );
+		}
+	}
+	else
+	{
+		int q = (-offset) >> 6, r = (-offset) & 63;
+
+		for ( int i = 0; i < dstWords; i++ )
+		{
+			uint64_t hi = ( i - q >= 0 && i - q < srcWords ? src[i - q] : fill );
+			uint64_t lo = ( i - q - 1 >= 0 && i - q - 1 < srcWords ? src[i - q - 1] : fill );
+			dst[i] = ( r == 0 ? hi : (hi << r) | (lo >> (64 - r)) );
+		}
+	}
+}
+
+/*
+ * Combines 'words' words of 'src' into 'dst' with OR (dilate) or AND (erode)
+ */
+static inline void combineWords( uint64_t *dst, const uint64_t *src, int words, bool dilate )
+{
+	if ( dilate )
+		for ( int i = 0; i < words; i++ ) dst[i] |= src[i];
+	else
+		for ( int i = 0; i < words; i++ ) dst[i] &= src[i];
+}
+
+/*
+ * Sets each pixel of 'dst' to the OR (dilate) or AND (erode) of the pixels of 'src' within 'halfWidth' of it along the row.
+ *
+ * The row is first copied into 'window' with 'halfWidth' pixels of padding on the left, so window[x] = src[x - halfWidth]. The
+ * window is then widened by doubling: after each step window[x] covers span pixels starting at x, so the cost grows with the log
+ * of the kernel width rather than the width itself.
+ */
+static void slideRow( const uint64_t *src, uint64_t *dst, int cols, int halfWidth, bool dilate,
+                      std::vector<uint64_t> *window, std::vector<uint64_t> *shifted )
+{
+	const uint64_t fill = ( dilate ? 0 : ~(uint64_t)0 );
+	const int words = ( cols + 63 ) / 64;
+	const int paddedWords = ( cols + 2 * halfWidth + 63 ) / 64;
+	const int length = 2 * halfWidth + 1;
+
+	window->resize( paddedWords );
+	shifted->resize( paddedWords );
+	uint64_t *w = &(*window)[0], *s = &(*shifted)[0];
+
+	shiftRow( src, words, w, paddedWords, -halfWidth, fill );
+
+	int span = 1;
+	while ( span * 2 <= length )
+	{
+		shiftRow( w, paddedWords, s, paddedWords, span, fill );
+		combineWords( w, s, paddedWords, dilate );
+		span *= 2;
+	}
+
+	if ( span < length )
+	{
+		shiftRow( w, paddedWords, s, paddedWords, length - span, fill );
+		combineWords( w, s, paddedWords, dilate );
+	}
+
+	for ( int i = 0; i < words; i++ ) dst[i] = w[i];
+}
+
+/*
+ * Erodes or dilates 'src' into 'dest' with a structuring element described by the half width of each of its rows (the middle row
+ * lines up with the pixel being worked on). Pixels outside the image never change the result, the same as OpenCV's default border.
+ */
+static void morphBits( const BitMask &src, BitMask *dest, const std::vector<int> &halfWidths, bool separable, bool dilate )
+{
+	const uint64_t fill = ( dilate ? 0 : ~(uint64_t)0 );
+	const int words = src.wordsPerRow;
+	const int radius = halfWidths.size() / 2;
+
+	// Scratch kept by each thread from call to call, so that once the masks and kernels have been seen nothing is allocated
+	static thread_local std::vector<uint64_t> window, shifted;
+	static thread_local std::map<int, BitMask> horizontal; // 'src' combined along each row, one copy per distinct half width
+	static thread_local std::vector<int> made; // Half widths in 'horizontal' worked out for this call
+	static thread_local BitMask input, columns;
+
+	input.create( src.rows, src.cols );
+	std::copy( src.words.begin(), src.words.end(), input.words.begin() );
+	for ( int y = 0; y < input.rows; y++ )
+		setRowTail( input.row(y), input.cols, words, fill );
+
+	made.clear();
+	for ( size_t i = 0; i < halfWidths.size(); i++ )
+	{
+		int halfWidth = halfWidths[i];
+
+		if ( halfWidth < 0 || std::find( made.begin(), made.end(), halfWidth ) != made.end() )
+			continue;
+
+		made.push_back( halfWidth );
+		BitMask &h = horizontal[halfWidth];
+		h.create( input.rows, input.cols );
+
+		for ( int y = 0; y < input.rows; y++ )
+		{
+			if ( halfWidth == 0 )
+				std::copy( input.row(y), input.row(y) + words, h.row(y) );
+			else
+				slideRow( input.row(y), h.row(y), input.cols, halfWidth, dilate, &window, &shifted );
+		}
+	}
+
+	dest->create( src.rows, src.cols );
+
+	if ( separable )
+	{
+		// Same doubling as along the rows, but down the columns: window row i holds row (i - radius) of the image
+		const BitMask &h = horizontal[ made[0] ];
+		const int length = 2 * radius + 1;
+		columns.create( src.rows + 2 * radius, src.cols );
+
+		for ( int i = 0; i < columns.rows; i++ )
+		{
+			int y = i - radius;
+
+			if ( y >= 0 && y < h.rows )
+				std::copy( h.row(y), h.row(y) + words, columns.row(i) );
+			else
+				std::fill( columns.row(i), columns.row(i) + words, fill );
+		}
+
+		int span = 1;
+		while ( span < length )
+		{
+			int step = ( span * 2 <= length ? span : length - span );
+
+			// Working forwards, row i + step has not been changed yet when row i reads it
+			for ( int i = 0; i + step < columns.rows; i++ )
+				combineWords( columns.row(i), columns.row(i + step), words, dilate );
+
+			span += step;
+		}
+
+		for ( int y = 0; y < src.rows; y++ )
+			std::copy( columns.row(y), columns.row(y) + words, dest->row(y) );
+	}
+	else
+	{
+		for ( int y = 0; y < src.rows; y++ )
+		{
+			uint64_t *out = dest->row(y);
+			std::fill( out, out + words, fill );
+
+			for ( int dy = -radius; dy <= radius; dy++ )
+			{
+				int halfWidth = halfWidths[dy + radius];
+
+				// Rows outside the image only hold 'fill', which never changes the result
+				if ( halfWidth < 0 || y + dy < 0 || y + dy >= src.rows )
+					continue;
+
+				combineWords( out, horizontal[halfWidth].row(y + dy), words, dilate );
+			}
+		}
+	}
+}
+
+/*
+ * Erodes a bit packed binary image. The result is the same as erodeImage with the same kernel type and size.
+ */
+void erodeBits( BitMask *src, BitMask *dest, int kernelType, int kernelSize )
+{
+	const MorphElement &e = getElement( kernelType, kernelSize );
+	morphBits( *src, dest, e.halfWidths, e.separable, false );
+}
+
+/*
+ * Dilates a bit packed binary image. The result is the same as dilateImage with the same kernel type and size.
+ */
+void dilateBits( BitMask *src, BitMask *dest, int kernelType, int kernelSize )
+{
+	const MorphElement &e = getElement( kernelType, kernelSize );
+	morphBits( *src, dest, e.halfWidths, e.separable, true );
+}
+
+/*
+ * Erodes a binary image, treating every non zero pixel as set. The result is 255 where the pixel survives and 0 elsewhere.
+ */
+void erodeBinary( Mat *src, Mat *dest, int kernelType, int kernelSize )
+{
+	BitMask bits, result;
+
+	bits.pack( *src );
+	erodeBits( &bits, &result, kernelType, kernelSize );
+	result.unpack( dest );
+}
+
+/*
+ * Dilates a binary image, treating every non zero pixel as set. The result is 255 where the pixel is set and 0 elsewhere.
+ */
+void dilateBinary( Mat *src, Mat *dest, int kernelType, int kernelSize )
+{
+	BitMask bits, result;
+
+	bits.pack( *src );
+	dilateBits( &bits, &result, kernelType, kernelSize );
+	result.unpack( dest );
+}
+
+/*
+ * Opens a binary image (erode then dilate), getting rid of set areas smaller than the kernel
+ */
+void openBinary( Mat *src, Mat *dest, int kernelType, int kernelSize )
+{
+	BitMask bits, eroded, result;
+
+	bits.pack( *src );
+	erodeBits( &bits, &eroded, kernelType, kernelSize );
+	dilateBits( &eroded, &result, kernelType, kernelSize );
+	result.unpack( dest );
+}
+
+/*
+ * Closes a binary image (dilate then erode), filling holes smaller than the kernel
+ */
+void closeBinary( Mat *src, Mat *dest, int kernelType, int kernelSize )
+{
+	BitMask bits, dilated, result;
+
+	bits.pack( *src );
+	dilateBits( &bits, &dilated, kernelType, kernelSize );
+	erodeBits( &dilated, &result, kernelType, kernelSize );
+	result.unpack( dest );
+}
+
+/*
+ * Checks that erodeBits and dilateBits give the same result as OpenCV's erode and dilate. Random masks of several widths, either
+ * side of a whole number of words, and of sparse and dense noise are eroded and dilated with every kernel type and with kernel
+ * sizes up to 'maxKernelSize'. Returns true if every result matches.
+ */
+bool checkBitMorphology( int maxKernelSize )
+{
+	const int widths[] = { 1, 37, 64, 65, 130, 200 };
+	const int densities[] = { 10, 50, 90 }; // Percentage of pixels set
+	RNG rng( 12345 );
+	Mat noise, mask, expected, result;
+	BitMask bits, resultBits;
+
+	for ( size_t w = 0; w < sizeof( widths ) / sizeof( widths[0] ); w++ )
+	{
+		for ( size_t d = 0; d < sizeof( densities ) / sizeof( densities[0] ); d++ )
+		{
+			noise.create( 47, widths[w], CV_8UC1 );
+			rng.fill( noise, RNG::UNIFORM, 0, 100 );
+			mask = ( noise < densities[d] );
+			bits.pack( mask );
+
+			for ( int kernelType = 0; kernelType <= max_elem; kernelType++ )
+			{
+				for ( int kernelSize = 0; kernelSize <= maxKernelSize; kernelSize++ )
+				{
+					const Mat &element = getElement( kernelType, kernelSize ).element;
+
+					erode( mask, expected, element );
+					erodeBits( &bits, &resultBits, kernelType, kernelSize );
+					resultBits.unpack( &result );
+					if ( countNonZero( result != expected ) != 0 )
+						return false;
+
+					dilate( mask, expected, element );
+					dilateBits( &bits, &resultBits, kernelType, kernelSize );
+					resultBits.unpack( &result );
+					if ( countNonZero( result != expected ) != 0 )
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+// ===================================================
+// 				BIT MASK CLASS
+// ===================================================
+
+BitMask::BitMask() : rows( 0 ), cols( 0 ), wordsPerRow( 0 ) { }
+
+BitMask::~BitMask() { }
+
+/*
+ * Sizes the mask for an image of 'r' rows and 'c' columns. The contents are not cleared.
+ */
+void BitMask::create( int r, int c )
+{
+	rows = r;
+	cols = c;
+	wordsPerRow = ( c + 63 ) / 64;
+	words.resize( rows * wordsPerRow );
+}
+
+/*
+ * Packs an 8 bit single channel image, setting the bit of every non zero pixel
+ */
+void BitMask::pack( const Mat &src )
+{
+	CV_Assert( src.type() == CV_8UC1 );
+
+	create( src.rows, src.cols );
+
+	for ( int y = 0; y < rows; y++ )
+	{
+		const uchar *p = src.ptr<uchar>(y);
+		uint64_t *w = row(y);
+
+		for ( int i = 0; i < wordsPerRow; i++ )
+		{
+			int end = std::min( 64, cols - 64 * i );
+			uint64_t word = 0;
+
+			for ( int b = 0; b < end; b++ )
+				word |= (uint64_t)( p[64 * i + b] != 0 ) << b;
+
+			w[i] = word;
+		}
+	}
+}
+
+/*
+ * Unpacks the mask into an 8 bit single channel image, with 255 for set pixels and 0 for the rest
+ */
+void BitMask::unpack( Mat *dest ) const
+{
+	dest->create( rows, cols, CV_8UC1 );
+
+	for ( int y = 0; y < rows; y++ )
+	{
+		uchar *p = dest->ptr<uchar>(y);
+		const uint64_t *w = row(y);
+
+		for ( int x = 0; x < cols; x++ )
+			p[x] = (uchar)( -(int)( ( w[x >> 6] >> (x & 63) ) & 1 ) );
+	}
+}
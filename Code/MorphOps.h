@@ -9,12 +9,43 @@
 
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
+#include <stdint.h>
+#include <vector>
 
 #ifndef MORPHOPS_H_
 #define MORPHOPS_H_
 
+/*
+ * A binary image stored 1 bit per pixel, 64 pixels to a word. Bit (x % 64) of word (x / 64) in a row holds pixel x.
+ */
+class BitMask {
+public:
+	// Variables
+	int rows, cols, wordsPerRow;
+	std::vector<uint64_t> words;
+
+	// Constructors
+	BitMask();
+	~BitMask();
+
+	// Functions
+	void create( int, int );
+	uint64_t* row( int y ) { return &words[ y * wordsPerRow ]; }
+	const uint64_t* row( int y ) const { return &words[ y * wordsPerRow ]; }
+	void pack( const cv::Mat& );
+	void unpack( cv::Mat* ) const;
+};
+
 void dilateImage( cv::Mat*, cv::Mat*, int, int );
 void erodeImage( cv::Mat*, cv::Mat*, int, int );
-void blurImage( cv::Mat*, cv::Mat*, int, int );
+void blurImage( cv::Mat*, cv::Mat*, int, int, cv::Mat *scratch = NULL );
+
+void erodeBinary( cv::Mat*, cv::Mat*, int, int );
+void dilateBinary( cv::Mat*, cv::Mat*, int, int );
+void openBinary( cv::Mat*, cv::Mat*, int, int );
+void closeBinary( cv::Mat*, cv::Mat*, int, int );
+void erodeBits( BitMask*, BitMask*, int, int );
+void dilateBits( BitMask*, BitMask*, int, int );
+bool checkBitMorphology( int maxKernelSize = 31 );
 
 #endif /* MORPHOPS_H_ */
@@ -0,0 +1,578 @@
+/*
+ * PixelKernels.cpp
+ *
+ *	Source file containing per-pixel kernels that fuse several OpenCV calls into a single pass. Each kernel has an SSSE3 and a NEON
+ *	version, with a plain C++ version for every other processor and for the pixels left over at the end of each row.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "PixelKernels.h"
+#include <algorithm>
+#include <math.h>
+
+#if defined( __SSSE3__ )
+#include <tmmintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#endif
+
+using namespace cv;
+
+// ================================= Variables ================================= //
+
+/*
+ * Fixed point weights used by cvtColor( CV_RGB2GRAY ) for 8 bit images, so the gray values here match OpenCV's exactly. The
+ * first channel is weighted as red, the same as the existing difference path. OpenCV 4 moved from 14 to 15 bits of precision.
+ */
+#if CV_MAJOR_VERSION >= 4
+const int grayShift = 15;
+const int grayWeight0 = 9798, grayWeight1 = 19235, grayWeight2 = 3735;
+#else
+const int grayShift = 14;
+const int grayWeight0 = 4899, grayWeight1 = 9617, grayWeight2 = 1868;
+#endif
+const int grayRound = 1 << (grayShift - 1);
+
+// ================================= End Variables ================================= //
+
+/*
+ * Returns the gray value of a single pixel
+ */
+static inline int grayPixel( const uchar *p )
+{
+	return ( p[0] * grayWeight0 + p[1] * grayWeight1 + p[2] * grayWeight2 + grayRound ) >> grayShift;
+}
+
+#if defined( __SSSE3__ )
+/*
+ * Splits 16 interleaved 3 channel pixels in 'a', 'b' and 'c' into one register per channel
+ */
+static inline void splitChannels( __m128i a, __m128i b, __m128i c, __m128i *c0, __m128i *c1, __m128i *c2 )
+{
+	*c0 = _mm_or_si128( _mm_or_si128(
+			_mm_shuffle_epi8( a, _mm_setr_epi8( 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 ) ),
+			_mm_shuffle_epi8( b, _mm_setr_epi8( -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1 ) ) ),
+			_mm_shuffle_epi8( c, _mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13 ) ) );
+	*c1 = _mm_or_si128( _mm_or_si128(
+			_mm_shuffle_epi8( a, _mm_setr_epi8( 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 ) ),
+			_mm_shuffle_epi8( b, _mm_setr_epi8( -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1 ) ) ),
+			_mm_shuffle_epi8( c, _mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14 ) ) );
+	*c2 = _mm_or_si128( _mm_or_si128(
+			_mm_shuffle_epi8( a, _mm_setr_epi8( 2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 ) ),
+			_mm_shuffle_epi8( b, _mm_setr_epi8( -1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1 ) ) ),
+			_mm_shuffle_epi8( c, _mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15 ) ) );
+}
+
+/*
+ * Returns the gray values of 4 pixels whose channels are in the 16 bit lanes of 'c0', 'c1' and 'c2'
+ */
+static inline __m128i grayQuad( __m128i c0, __m128i c1, __m128i c2 )
+{
+	// Pair channels up so that one multiply-add handles two weights: (c0, c1) . (w0, w1) + (c2, 1) . (w2, round)
+	const __m128i weights01 = _mm_setr_epi16( grayWeight0, grayWeight1, grayWeight0, grayWeight1, grayWeight0, grayWeight1, grayWeight0, grayWeight1 );
+	const __m128i weights2r = _mm_setr_epi16( grayWeight2, grayRound, grayWeight2, grayRound, grayWeight2, grayRound, grayWeight2, grayRound );
+	const __m128i one = _mm_set1_epi16( 1 );
+
+	__m128i sum = _mm_add_epi32( _mm_madd_epi16( _mm_unpacklo_epi16( c0, c1 ), weights01 ),
+	                             _mm_madd_epi16( _mm_unpacklo_epi16( c2, one ), weights2r ) );
+
+	return _mm_srli_epi32( sum, grayShift );
+}
+
+/*
+ * Returns the gray values of 16 interleaved 3 channel pixels starting at 'p'
+ */
+static inline __m128i grayPixels16( const uchar *p )
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i c0, c1, c2;
+
+	splitChannels( _mm_loadu_si128( (const __m128i*)p ),
+	               _mm_loadu_si128( (const __m128i*)(p + 16) ),
+	               _mm_loadu_si128( (const __m128i*)(p + 32) ), &c0, &c1, &c2 );
+
+	__m128i c0lo = _mm_unpacklo_epi8( c0, zero ), c0hi = _mm_unpackhi_epi8( c0, zero );
+	__m128i c1lo = _mm_unpacklo_epi8( c1, zero ), c1hi = _mm_unpackhi_epi8( c1, zero );
+	__m128i c2lo = _mm_unpacklo_epi8( c2, zero ), c2hi = _mm_unpackhi_epi8( c2, zero );
+
+	__m128i g0 = grayQuad( c0lo, c1lo, c2lo );
+	__m128i g1 = grayQuad( _mm_unpackhi_epi64( c0lo, c0lo ), _mm_unpackhi_epi64( c1lo, c1lo ), _mm_unpackhi_epi64( c2lo, c2lo ) );
+	__m128i g2 = grayQuad( c0hi, c1hi, c2hi );
+	__m128i g3 = grayQuad( _mm_unpackhi_epi64( c0hi, c0hi ), _mm_unpackhi_epi64( c1hi, c1hi ), _mm_unpackhi_epi64( c2hi, c2hi ) );
+
+	return _mm_packus_epi16( _mm_packs_epi32( g0, g1 ), _mm_packs_epi32( g2, g3 ) );
+}
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+/*
+ * Returns the gray values of 8 pixels whose channels are in the 16 bit lanes of 'c0', 'c1' and 'c2'
+ */
+static inline uint8x8_t grayPixels8( uint16x8_t c0, uint16x8_t c1, uint16x8_t c2 )
+{
+	uint32x4_t lo = vdupq_n_u32( grayRound ), hi = vdupq_n_u32( grayRound );
+
+	lo = vmlal_n_u16( lo, vget_low_u16( c0 ), grayWeight0 );
+	lo = vmlal_n_u16( lo, vget_low_u16( c1 ), grayWeight1 );
+	lo = vmlal_n_u16( lo, vget_low_u16( c2 ), grayWeight2 );
+	hi = vmlal_n_u16( hi, vget_high_u16( c0 ), grayWeight0 );
+	hi = vmlal_n_u16( hi, vget_high_u16( c1 ), grayWeight1 );
+	hi = vmlal_n_u16( hi, vget_high_u16( c2 ), grayWeight2 );
+
+	return vmovn_u16( vcombine_u16( vshrn_n_u32( lo, grayShift ), vshrn_n_u32( hi, grayShift ) ) );
+}
+
+/*
+ * Returns the gray values of 16 interleaved 3 channel pixels starting at 'p'
+ */
+static inline uint8x16_t grayPixels16( const uchar *p )
+{
+	uint8x16x3_t c = vld3q_u8( p );
+
+	return vcombine_u8(
+			grayPixels8( vmovl_u8( vget_low_u8( c.val[0] ) ), vmovl_u8( vget_low_u8( c.val[1] ) ), vmovl_u8( vget_low_u8( c.val[2] ) ) ),
+			grayPixels8( vmovl_u8( vget_high_u8( c.val[0] ) ), vmovl_u8( vget_high_u8( c.val[1] ) ), vmovl_u8( vget_high_u8( c.val[2] ) ) ) );
+}
+#endif
+
+/*
+ * Runs the fused difference kernel over one row of 'width' pixels. 'difference' may be NULL.
+ */
+static void differenceThresholdRow( const uchar *first, const uchar *second, uchar *mask, uchar *difference, int width, int thresh )
+{
+	int x = 0;
+
+#if defined( __SSSE3__ )
+	// A pixel passes when its difference is at least thresh + 1; no pixel can pass a threshold of 255 or more
+	const __m128i passLevel = _mm_set1_epi8( (char)( thresh < 0 ? 0 : thresh + 1 ) );
+
+	if ( thresh < 255 )
+	{
+		for ( ; x <= width - 16; x += 16 )
+		{
+			__m128i g1 = grayPixels16( first + 3 * x );
+			__m128i g2 = grayPixels16( second + 3 * x );
+			__m128i d = _mm_or_si128( _mm_subs_epu8( g1, g2 ), _mm_subs_epu8( g2, g1 ) );
+
+			_mm_storeu_si128( (__m128i*)(mask + x), _mm_cmpeq_epi8( _mm_max_epu8( d, passLevel ), d ) );
+			if ( difference ) _mm_storeu_si128( (__m128i*)(difference + x), d );
+		}
+	}
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+	const uint8x16_t threshLevel = vdupq_n_u8( (uchar)( thresh < 0 ? 0 : thresh ) );
+
+	if ( thresh >= 0 && thresh < 255 )
+	{
+		for ( ; x <= width - 16; x += 16 )
+		{
+			uint8x16_t d = vabdq_u8( grayPixels16( first + 3 * x ), grayPixels16( second + 3 * x ) );
+
+			vst1q_u8( mask + x, vcgtq_u8( d, threshLevel ) );
+			if ( difference ) vst1q_u8( difference + x, d );
+		}
+	}
+#endif
+
+	for ( ; x < width; x++ )
+	{
+		int d = std::abs( grayPixel( first + 3 * x ) - grayPixel( second + 3 * x ) );
+
+		mask[x] = ( d > thresh ? 255 : 0 );
+		if ( difference ) difference[x] = (uchar)d;
+	}
+}
+
+/*
+ * Converts two 3 channel 8 bit frames to gray, takes their absolute difference and thresholds it, all in one pass. The binary
+ * result is written to 'mask' and, if 'difference' is not NULL, the difference image is written there too. The result is the same
+ * as calling cvtColor( CV_RGB2GRAY ) on both frames, absdiff, then threshold( THRESH_BINARY ) with a max value of 255.
+ */
+void differenceThreshold( const Mat &first, const Mat &second, int thresh, Mat *mask, Mat *difference )
+{
+	CV_Assert( first.type() == CV_8UC3 && second.type() == CV_8UC3 && first.size() == second.size() );
+
+	mask->create( first.size(), CV_8UC1 );
+	if ( difference ) difference->create( first.size(), CV_8UC1 );
+
+	for ( int y = 0; y < first.rows; y++ )
+	{
+		differenceThresholdRow( first.ptr<uchar>(y), second.ptr<uchar>(y), mask->ptr<uchar>(y),
+		                        difference ? difference->ptr<uchar>(y) : NULL, first.cols, thresh );
+	}
+}
+
+/*
+ * Converts one row of 'width' 3 channel pixels to gray
+ */
+static void grayRow( const uchar *src, uchar *gray, int width )
+{
+	int x = 0;
+
+#if defined( __SSSE3__ ) || defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+	for ( ; x <= width - 16; x += 16 )
+	{
+#if defined( __SSSE3__ )
+		_mm_storeu_si128( (__m128i*)(gray + x), grayPixels16( src + 3 * x ) );
+#else
+		vst1q_u8( gray + x, grayPixels16( src + 3 * x ) );
+#endif
+	}
+#endif
+
+	for ( ; x < width; x++ )
+		gray[x] = (uchar)grayPixel( src + 3 * x );
+}
+
+/*
+ * Runs the streaming difference kernel over one row of 'width' pixels, comparing 'src' with the gray row 'previous'. 'difference'
+ * and 'gray' may be NULL.
+ */
+static void grayDifferenceThresholdRow( const uchar *previous, const uchar *src, uchar *mask, uchar *difference, uchar *gray,
+                                        int width, int thresh )
+{
+	int x = 0;
+
+#if defined( __SSSE3__ )
+	const __m128i passLevel = _mm_set1_epi8( (char)( thresh < 0 ? 0 : thresh + 1 ) );
+
+	if ( thresh < 255 )
+	{
+		for ( ; x <= width - 16; x += 16 )
+		{
+			__m128i g = grayPixels16( src + 3 * x );
+			__m128i p = _mm_loadu_si128( (const __m128i*)(previous + x) );
+			__m128i d = _mm_or_si128( _mm_subs_epu8( g, p ), _mm_subs_epu8( p, g ) );
+
+			_mm_storeu_si128( (__m128i*)(mask + x), _mm_cmpeq_epi8( _mm_max_epu8( d, passLevel ), d ) );
+			if ( difference ) _mm_storeu_si128( (__m128i*)(difference + x), d );
+			if ( gray ) _mm_storeu_si128( (__m128i*)(gray + x), g );
+		}
+	}
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+	const uint8x16_t threshLevel = vdupq_n_u8( (uchar)( thresh < 0 ? 0 : thresh ) );
+
+	if ( thresh >= 0 && thresh < 255 )
+	{
+		for ( ; x <= width - 16; x += 16 )
+		{
+			uint8x16_t g = grayPixels16( src + 3 * x );
+			uint8x16_t d = vabdq_u8( g, vld1q_u8( previous + x ) );
+
+			vst1q_u8( mask + x, vcgtq_u8( d, threshLevel ) );
+			if ( difference ) vst1q_u8( difference + x, d );
+			if ( gray ) vst1q_u8( gray + x, g );
+		}
+	}
+#endif
+
+	for ( ; x < width; x++ )
+	{
+		int g = grayPixel( src + 3 * x );
+		int d = std::abs( g - previous[x] );
+
+		mask[x] = ( d > thresh ? 255 : 0 );
+		if ( difference ) difference[x] = (uchar)d;
+		if ( gray ) gray[x] = (uchar)g;
+	}
+}
+
+/*
+ * Converts a 3 channel 8 bit frame to gray, the same as cvtColor( CV_RGB2GRAY ).
+ */
+void grayFrame( const Mat &src, Mat *gray )
+{
+	CV_Assert( src.type() == CV_8UC3 );
+
+	gray->create( src.size(), CV_8UC1 );
+
+	for ( int y = 0; y < src.rows; y++ )
+		grayRow( src.ptr<uchar>(y), gray->ptr<uchar>(y), src.cols );
+}
+
+/*
+ * Puts the HSV value of each pixel of one row of 'width' 3 channel pixels, the brightest of its channels, into 'value'
+ */
+static void valueRow( const uchar *src, uchar *value, int width )
+{
+	int x = 0;
+
+#if defined( __SSSE3__ )
+	for ( ; x <= width - 16; x += 16 )
+	{
+		const uchar *p = src + 3 * x;
+		__m128i c0, c1, c2;
+
+		splitChannels( _mm_loadu_si128( (const __m128i*)p ),
+		               _mm_loadu_si128( (const __m128i*)(p + 16) ),
+		               _mm_loadu_si128( (const __m128i*)(p + 32) ), &c0, &c1, &c2 );
+
+		_mm_storeu_si128( (__m128i*)(value + x), _mm_max_epu8( c0, _mm_max_epu8( c1, c2 ) ) );
+	}
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+	for ( ; x <= width - 16; x += 16 )
+	{
+		uint8x16x3_t c = vld3q_u8( src + 3 * x );
+		vst1q_u8( value + x, vmaxq_u8( c.val[0], vmaxq_u8( c.val[1], c.val[2] ) ) );
+	}
+#endif
+
+	for ( ; x < width; x++ )
+	{
+		const uchar *p = src + 3 * x;
+		value[x] = std::max( p[0], std::max( p[1], p[2] ) );
+	}
+}
+
+/*
+ * Puts the value channel of a 3 channel 8 bit frame into 'value', the same as the third channel of cvtColor( CV_BGR2HSV ), without
+ * working out hue and saturation.
+ */
+void valueFrame( const Mat &src, Mat *value )
+{
+	CV_Assert( src.type() == CV_8UC3 );
+
+	value->create( src.size(), CV_8UC1 );
+
+	for ( int y = 0; y < src.rows; y++ )
+		valueRow( src.ptr<uchar>(y), value->ptr<uchar>(y), src.cols );
+}
+
+/*
+ * Streaming version of differenceThreshold: compares a 3 channel 8 bit frame 'src' with the gray image of an earlier frame,
+ * 'previous', so each frame of a stream is only converted to gray once. The gray image of 'src' is written to 'gray' if it is not
+ * NULL, ready to be 'previous' for the next frame; it must not be the same Mat as 'previous'. 'difference' may be NULL.
+ */
+void grayDifferenceThreshold( const Mat &previous, const Mat &src, int thresh, Mat *mask, Mat *difference, Mat *gray )
+{
+	CV_Assert( previous.type() == CV_8UC1 && src.type() == CV_8UC3 && previous.size() == src.size() );
+
+	mask->create( src.size(), CV_8UC1 );
+	if ( difference ) difference->create( src.size(), CV_8UC1 );
+	if ( gray ) gray->create( src.size(), CV_8UC1 );
+
+	for ( int y = 0; y < src.rows; y++ )
+	{
+		grayDifferenceThresholdRow( previous.ptr<uchar>(y), src.ptr<uchar>(y), mask->ptr<uchar>(y),
+		                            difference ? difference->ptr<uchar>(y) : NULL, gray ? gray->ptr<uchar>(y) : NULL, src.cols, thresh );
+	}
+}
+
+#if defined( __SSSE3__ )
+/*
+ * Runs the background kernel on 4 pixels whose gray values are in the 32 bit lanes of 'gray', and returns the difference of each in
+ * the same lanes with its pass mask in 'pass'
+ */
+static inline __m128i backgroundQuad( __m128i gray, float *background, float *variance, __m128 rate, __m128 thresh, __m128 sigmas2,
+                                      __m128i *pass )
+{
+	const __m128 signMask = _mm_set1_ps( -0.f );
+	const __m128 half = _mm_set1_ps( 0.5f );
+
+	__m128 g = _mm_cvtepi32_ps( gray );
+	__m128 b = _mm_loadu_ps( background );
+	__m128 diff = _mm_sub_ps( g, b );
+	__m128 d = _mm_andnot_ps( signMask, diff );
+	__m128 passes = _mm_cmpgt_ps( d, thresh );
+
+	if ( variance )
+	{
+		__m128 v = _mm_loadu_ps( variance );
+		__m128 d2 = _mm_mul_ps( d, d );
+
+		passes = _mm_and_ps( passes, _mm_cmpgt_ps( d2, _mm_mul_ps( sigmas2, v ) ) );
+		_mm_storeu_ps( variance, _mm_add_ps( v, _mm_mul_ps( rate, _mm_sub_ps( d2, v ) ) ) );
+	}
+
+	_mm_storeu_ps( background, _mm_add_ps( b, _mm_mul_ps( rate, diff ) ) );
+
+	*pass = _mm_castps_si128( passes );
+	return _mm_cvttps_epi32( _mm_add_ps( d, half ) );
+}
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+/*
+ * Runs the background kernel on 4 pixels whose gray values are in the 32 bit lanes of 'gray', and returns the difference of each in
+ * the same lanes with its pass mask in 'pass'
+ */
+static inline uint32x4_t backgroundQuad( uint32x4_t gray, float *background, float *variance, float rate, float thresh, float sigmas2,
+                                         uint32x4_t *pass )
+{
+	float32x4_t g = vcvtq_f32_u32( gray );
+	float32x4_t b = vld1q_f32( background );
+	float32x4_t diff = vsubq_f32( g, b );
+	float32x4_t d = vabsq_f32( diff );
+	uint32x4_t passes = vcgtq_f32( d, vdupq_n_f32( thresh ) );
+
+	if ( variance )
+	{
+		float32x4_t v = vld1q_f32( variance );
+		float32x4_t d2 = vmulq_f32( d, d );
+
+		passes = vandq_u32( passes, vcgtq_f32( d2, vmulq_n_f32( v, sigmas2 ) ) );
+		vst1q_f32( variance, vmlaq_n_f32( v, vsubq_f32( d2, v ), rate ) );
+	}
+
+	vst1q_f32( background, vmlaq_n_f32( b, diff, rate ) );
+
+	*pass = passes;
+	return vcvtq_u32_f32( vaddq_f32( d, vdupq_n_f32( 0.5f ) ) );
+}
+#endif
+
+/*
+ * Runs the background kernel over one row of 'width' pixels. 'variance' and 'difference' may be NULL.
+ */
+static void backgroundDifferenceThresholdRow( const uchar *src, float *background, float *variance, uchar *mask, uchar *difference,
+                                              int width, float rate, int thresh, float sigmas2 )
+{
+	int x = 0;
+
+#if defined( __SSSE3__ )
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 rateV = _mm_set1_ps( rate ), threshV = _mm_set1_ps( (float)thresh ), sigmas2V = _mm_set1_ps( sigmas2 );
+
+	for ( ; x <= width - 16; x += 16 )
+	{
+		__m128i g = grayPixels16( src + 3 * x );
+		__m128i glo = _mm_unpacklo_epi8( g, zero ), ghi = _mm_unpackhi_epi8( g, zero );
+		__m128i d[4], pass[4];
+
+		d[0] = backgroundQuad( _mm_unpacklo_epi16( glo, zero ), background + x, variance ? variance + x : NULL, rateV, threshV, sigmas2V, &pass[0] );
+		d[1] = backgroundQuad( _mm_unpackhi_epi16( glo, zero ), background + x + 4, variance ? variance + x + 4 : NULL, rateV, threshV, sigmas2V, &pass[1] );
+		d[2] = backgroundQuad( _mm_unpacklo_epi16( ghi, zero ), background + x + 8, variance ? variance + x + 8 : NULL, rateV, threshV, sigmas2V, &pass[2] );
+		d[3] = backgroundQuad( _mm_unpackhi_epi16( ghi, zero ), background + x + 12, variance ? variance + x + 12 : NULL, rateV, threshV, sigmas2V, &pass[3] );
+
+		_mm_storeu_si128( (__m128i*)(mask + x), _mm_packs_epi16( _mm_packs_epi32( pass[0], pass[1] ), _mm_packs_epi32( pass[2], pass[3] ) ) );
+		if ( difference )
+			_mm_storeu_si128( (__m128i*)(difference + x), _mm_packus_epi16( _mm_packs_epi32( d[0], d[1] ), _mm_packs_epi32( d[2], d[3] ) ) );
+	}
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+	for ( ; x <= width - 16; x += 16 )
+	{
+		uint8x16_t g = grayPixels16( src + 3 * x );
+		uint16x8_t glo = vmovl_u8( vget_low_u8( g ) ), ghi = vmovl_u8( vget_high_u8( g ) );
+		uint32x4_t d[4], pass[4];
+
+		d[0] = backgroundQuad( vmovl_u16( vget_low_u16( glo ) ), background + x, variance ? variance + x : NULL, rate, (float)thresh, sigmas2, &pass[0] );
+		d[1] = backgroundQuad( vmovl_u16( vget_high_u16( glo ) ), background + x + 4, variance ? variance + x + 4 : NULL, rate, (float)thresh, sigmas2, &pass[1] );
+		d[2] = backgroundQuad( vmovl_u16( vget_low_u16( ghi ) ), background + x + 8, variance ? variance + x + 8 : NULL, rate, (float)thresh, sigmas2, &pass[2] );
+		d[3] = backgroundQuad( vmovl_u16( vget_high_u16( ghi ) ), background + x + 12, variance ? variance + x + 12 : NULL, rate, (float)thresh, sigmas2, &pass[3] );
+
+		vst1q_u8( mask + x, vcombine_u8( vmovn_u16( vcombine_u16( vmovn_u32( pass[0] ), vmovn_u32( pass[1] ) ) ),
+		                                 vmovn_u16( vcombine_u16( vmovn_u32( pass[2] ), vmovn_u32( pass[3] ) ) ) ) );
+		if ( difference )
+			vst1q_u8( difference + x, vcombine_u8( vqmovn_u16( vcombine_u16( vqmovn_u32( d[0] ), vqmovn_u32( d[1] ) ) ),
+			                                       vqmovn_u16( vcombine_u16( vqmovn_u32( d[2] ), vqmovn_u32( d[3] ) ) ) ) );
+	}
+#endif
+
+	for ( ; x < width; x++ )
+	{
+		float diff = grayPixel( src + 3 * x ) - background[x];
+		float d = fabs( diff );
+		bool passes = d > thresh;
+
+		if ( variance )
+		{
+			passes = passes && d * d > sigmas2 * variance[x];
+			variance[x] += rate * ( d * d - variance[x] );
+		}
+
+		background[x] += rate * diff;
+
+		mask[x] = ( passes ? 255 : 0 );
+		if ( difference ) difference[x] = (uchar)std::min( (int)( d + 0.5f ), 255 );
+	}
+}
+
+/*
+ * Compares a 3 channel 8 bit frame with a running average background and updates the background, all in one pass. 'background' is
+ * a float gray image, and each of its pixels moves towards the frame's gray value by 'rate'. A pixel is set in 'mask' if its gray
+ * value differs from the background by more than 'thresh'.
+ *
+ * If 'variance' is not NULL it is a float image of the variance of each pixel about the background, updated at the same rate, and
+ * a pixel must also differ by more than 'sigmas' standard deviations to be set. 'difference' gets the rounded absolute difference if
+ * it is not NULL.
+ */
+void backgroundDifferenceThreshold( const Mat &src, Mat *background, Mat *variance, float rate, int thresh, float sigmas, Mat *mask,
+                                    Mat *difference )
+{
+	CV_Assert( src.type() == CV_8UC3 && background->type() == CV_32FC1 && background->size() == src.size() );
+	CV_Assert( !variance || ( variance->type() == CV_32FC1 && variance->size() == src.size() ) );
+
+	mask->create( src.size(), CV_8UC1 );
+	if ( difference ) difference->create( src.size(), CV_8UC1 );
+
+	for ( int y = 0; y < src.rows; y++ )
+	{
+		backgroundDifferenceThresholdRow( src.ptr<uchar>(y), background->ptr<float>(y), variance ? variance->ptr<float>(y) : NULL,
+		                                  mask->ptr<uchar>(y), difference ? difference->ptr<uchar>(y) : NULL, src.cols, rate, thresh,
+		                                  sigmas * sigmas );
+	}
+}
+
+/*
+ * Marks which square tiles of side 'tileSize' have changed between two 3 channel 8 bit frames. Only the gray value of every
+ * 'step'th pixel in each direction is compared, and 'changed' gets one pixel per tile: 255 if the largest sampled difference in the
+ * tile is more than 'level', otherwise 0. The largest difference is used rather than the sum, so that a single small spot is not
+ * averaged away over its tile. Returns the number of changed tiles.
+ */
+int blockChanges( const Mat &first, const Mat &second, int tileSize, int step, int level, Mat *changed )
+{
+	CV_Assert( first.type() == CV_8UC3 && second.type() == CV_8UC3 && first.size() == second.size() && tileSize > 0 && step > 0 );
+
+	int tileRows = ( first.rows + tileSize - 1 ) / tileSize;
+	int tileCols = ( first.cols + tileSize - 1 ) / tileSize;
+	int count = 0;
+
+	changed->create( tileRows, tileCols, CV_8UC1 );
+
+	for ( int ty = 0; ty < tileRows; ty++ )
+	{
+		uchar *peak = changed->ptr<uchar>(ty);
+		int yEnd = std::min( ( ty + 1 ) * tileSize, first.rows );
+
+		std::fill( peak, peak + tileCols, 0 );
+
+		// Sample from the middle of each step so the edges of the tile are not favoured
+		for ( int y = ty * tileSize + step / 2; y < yEnd; y += step )
+		{
+			const uchar *a = first.ptr<uchar>(y);
+			const uchar *b = second.ptr<uchar>(y);
+
+			for ( int x = step / 2; x < first.cols; x += step )
+			{
+				int d = std::abs( grayPixel( a + 3 * x ) - grayPixel( b + 3 * x ) );
+				uchar &p = peak[ x / tileSize ];
+
+				if ( d > p ) p = (uchar)d;
+			}
+		}
+
+		for ( int tx = 0; tx < tileCols; tx++ )
+		{
+			peak[tx] = ( peak[tx] > level ? 255 : 0 );
+			if ( peak[tx] ) count++;
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Runs both the fused kernel and the separate OpenCV calls on the same two frames, and returns true if they give exactly the same
+ * mask and difference image.
+ */
+bool checkDifferenceThreshold( const Mat &first, const Mat &second, int thresh )
+{
+	Mat firstGray, secondGray, expectedDifference, expectedMask;
+	Mat mask, difference;
+
+	cvtColor( first, firstGray, CV_RGB2GRAY );
+	cvtColor( second, secondGray, CV_RGB2GRAY );
+	absdiff( firstGray, secondGray, expectedDifference );
+	threshold( expectedDifference, expectedMask, thresh, 255, THRESH_BINARY );
+
+	differenceThreshold( first, second, thresh, &mask, &difference );
+
+	return countNonZero( mask != expectedMask ) == 0 && countNonZero( difference != expectedDifference ) == 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * PixelKernels.h
+ *
+ * Header file for hand written per-pixel kernels that do the work of several OpenCV calls in a single pass over an image.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <opencv/cv.h>
+
+#ifndef PIXELKERNELS_H_
+#define PIXELKERNELS_H_
+
+void differenceThreshold( const cv::Mat&, const cv::Mat&, int, cv::Mat*, cv::Mat* );
+bool checkDifferenceThreshold( const cv::Mat&, const cv::Mat&, int );
+void grayFrame( const cv::Mat&, cv::Mat* );
+void valueFrame( const cv::Mat&, cv::Mat* );
+void grayDifferenceThreshold( const cv::Mat&, const cv::Mat&, int, cv::Mat*, cv::Mat*, cv::Mat* );
+int blockChanges( const cv::Mat&, const cv::Mat&, int, int, int, cv::Mat* );
+void backgroundDifferenceThreshold( const cv::Mat&, cv::Mat*, cv::Mat*, float, int, float, cv::Mat*, cv::Mat* );
+
+#endif /* PIXELKERNELS_H_ */
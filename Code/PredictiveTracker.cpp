@@ -0,0 +1,352 @@
+/*
+ * PredictiveTracker.cpp
+ *
+ *	Source file containing Kalman filter tracking of light spots. Each spot found is given a constant velocity filter, and in the
+ *	frames after that only a gating window around each prediction is searched, which is a small fraction of the frame.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "PredictiveTracker.h"
+#include <algorithm>
+#include <math.h>
+
+using namespace cv;
+using namespace std;
+
+// ================================= Variables ================================= //
+
+// Variance of a spot's position and velocity when its track starts, in pixels squared
+const float initialPositionVariance = 4;
+const float initialVelocityVariance = 25;
+
+// Smallest variance of a measured position in each direction, the error of sampling on a pixel grid
+const float minMeasurementVariance = 1.f / 12;
+
+// ================================= End Variables ================================= //
+
+/*
+ *	Constructor for PredictiveTracker class that takes the tracker whose pipeline is used to find spots
+ */
+PredictiveTracker::PredictiveTracker( SpotTracker *spotTracker )
+{
+	tracker = spotTracker;
+
+	fullPassInterval = 30;
+	maxMisses = 3;
+	gateSigmas = 3;
+	minGate = 8;
+	processNoise = 1;
+
+	pixelsProcessed = 0;
+	fullPass = true;
+
+	reset();
+}
+
+PredictiveTracker::~PredictiveTracker() { }
+
+// ============= Functions
+/*
+ * Tracks spots by difference between 'first' and 'second', searching the whole frame only when it is due or a spot was lost
+ */
+void PredictiveTracker::trackByDifference( const Mat &first, const Mat &second )
+{
+	track( true, &first, &second );
+}
+
+/*
+ * Tracks spots by colour in 'src', searching the whole frame only when it is due or a spot was lost
+ */
+void PredictiveTracker::trackByColour( const Mat &src )
+{
+	track( false, &src, NULL );
+}
+
+/*
+ * Drops every track so that the next frame is searched in full
+ */
+void PredictiveTracker::reset()
+{
+	tracks.clear();
+	framesSinceFullPass = 0;
+	lost = false;
+	nextId = 0;
+}
+
+/*
+ * Predicts where every spot is in this frame, then either runs the full pipeline over the frame and matches its spots to the
+ * tracks, or searches only the gating window of each track.
+ */
+void PredictiveTracker::track( bool byDifference, const Mat *first, const Mat *second )
+{
+	predict();
+
+	fullPass = tracks.empty() || lost || framesSinceFullPass >= fullPassInterval;
+
+	if ( fullPass )
+	{
+		if ( byDifference )
+			tracker->trackByDifference( *first, *second );
+		else
+			tracker->trackByColour( *first );
+
+		pixelsProcessed = tracker->frame.total();
+		framesSinceFullPass = 0;
+
+		associateFullPass();
+	}
+	else
+	{
+		if ( byDifference )
+			tracker->loadFrames( *first, *second );
+		else
+			tracker->loadFrame( *first );
+
+		framesSinceFullPass++;
+
+		searchGates( byDifference );
+	}
+
+	finishFrame();
+}
+
+/*
+ * Moves every filter on by one frame and sets each track's predicted position and gating window. The window grows with the
+ * uncertainty of the prediction and with the size of the spot.
+ */
+void PredictiveTracker::predict()
+{
+	for ( size_t i = 0; i < tracks.size(); i++ )
+	{
+		SpotTrack &t = tracks[i];
+		const Mat &state = t.filter.predict();
+
+		t.predicted = Point2f( state.at<float>(0), state.at<float>(1) );
+
+		// Spread of the innovation: predicted position variance plus measurement variance
+		float sx = sqrt( t.filter.errorCovPre.at<float>(0, 0) + t.filter.measurementNoiseCov.at<float>(0, 0) );
+		float sy = sqrt( t.filter.errorCovPre.at<float>(1, 1) + t.filter.measurementNoiseCov.at<float>(1, 1) );
+
+		int halfWidth = max( minGate, cvCeil( gateSigmas * sx ) ) + t.spot.box.width / 2;
+		int halfHeight = max( minGate, cvCeil( gateSigmas * sy ) ) + t.spot.box.height / 2;
+
+		t.gate = Rect( cvFloor( t.predicted.x ) - halfWidth, cvFloor( t.predicted.y ) - halfHeight, 2 * halfWidth + 1, 2 * halfHeight + 1 );
+	}
+}
+
+/*
+ * Matches the spots of a full frame pass to the tracks. Each track takes the nearest unused spot of its colour class inside its
+ * gating window; spots left over start new tracks. The spots are put in a spatial hash so each track only looks at spots near its
+ * window.
+ */
+void PredictiveTracker::associateFullPass()
+{
+	const vector<Spot> &detections = tracker->spots;
+
+	detectionUsed.assign( detections.size(), false );
+	hash.build( detections, 2.f * minGate );
+
+	for ( size_t i = 0; i < tracks.size(); i++ )
+	{
+		SpotTrack &t = tracks[i];
+		int best = -1;
+		float bestDistance = 0;
+
+		found.clear();
+		hash.query( Point2f( t.gate.x + 0.5f * t.gate.width, t.gate.y + 0.5f * t.gate.height ), 0.5f * t.gate.width, 0.5f * t.gate.height, &found );
+
+		for ( size_t f = 0; f < found.size(); f++ )
+		{
+			int j = found[f];
+			const Spot &d = detections[j];
+
+			if ( detectionUsed[j] || d.colourClass != t.spot.colourClass )
+				continue;
+			if ( d.centre.x < t.gate.x || d.centre.x >= t.gate.x + t.gate.width || d.centre.y < t.gate.y || d.centre.y >= t.gate.y + t.gate.height )
+				continue;
+
+			float dx = d.centre.x - t.predicted.x, dy = d.centre.y - t.predicted.y;
+			float distance = dx * dx + dy * dy;
+
+			if ( best < 0 || distance < bestDistance )
+			{
+				best = j;
+				bestDistance = distance;
+			}
+		}
+
+		if ( best >= 0 )
+		{
+			detectionUsed[best] = true;
+			correct( &t, detections[best] );
+		}
+		else
+			t.misses++;
+	}
+
+	for ( size_t j = 0; j < detections.size(); j++ )
+	{
+		if ( !detectionUsed[j] )
+			startTrack( detections[j] );
+	}
+}
+
+/*
+ * Looks for each track's spot only inside its gating window. Gates can overlap, so the spots of every gate are collected first and
+ * then given out nearest first: each spot goes to at most one track, and each track takes at most one spot.
+ */
+void PredictiveTracker::searchGates( bool byDifference )
+{
+	Rect bounds( 0, 0, tracker->frame.cols, tracker->frame.rows );
+	vector<Spot> &detections = tracker->spots;
+
+	detections.clear();
+	pixelsProcessed = 0;
+
+	for ( size_t i = 0; i < tracks.size(); i++ )
+	{
+		Rect gate = tracks[i].gate & bounds;
+		size_t firstFound = detections.size();
+
+		tracker->findSpotsInWindow( gate, gate, byDifference, tracks[i].spot.colourClass );
+		pixelsProcessed += gate.area();
+
+		// A spot inside two overlapping gates is found by both; keep it once
+		for ( size_t j = firstFound; j < detections.size(); )
+		{
+			bool seen = false;
+
+			for ( size_t k = 0; k < firstFound && !seen; k++ )
+				seen = detections[k].box == detections[j].box && detections[k].colourClass == detections[j].colourClass;
+
+			if ( seen )
+				detections.erase( detections.begin() + j );
+			else
+				j++;
+		}
+	}
+
+	// Every pairing of a track with a spot of its colour class inside its gate
+	candidates.clear();
+
+	for ( size_t i = 0; i < tracks.size(); i++ )
+	{
+		const SpotTrack &t = tracks[i];
+
+		for ( size_t j = 0; j < detections.size(); j++ )
+		{
+			const Spot &d = detections[j];
+
+			if ( d.colourClass != t.spot.colourClass || !t.gate.contains( Point( cvFloor( d.centre.x ), cvFloor( d.centre.y ) ) ) )
+				continue;
+
+			float dx = d.centre.x - t.predicted.x, dy = d.centre.y - t.predicted.y;
+			GateCandidate candidate = { dx * dx + dy * dy, (int)i, (int)j };
+			candidates.push_back( candidate );
+		}
+	}
+
+	std::sort( candidates.begin(), candidates.end() );
+
+	detectionUsed.assign( detections.size(), false );
+	trackMatched.assign( tracks.size(), false );
+
+	for ( size_t c = 0; c < candidates.size(); c++ )
+	{
+		const GateCandidate &candidate = candidates[c];
+
+		if ( trackMatched[candidate.track] || detectionUsed[candidate.spot] )
+			continue;
+
+		trackMatched[candidate.track] = true;
+		detectionUsed[candidate.spot] = true;
+		correct( &tracks[candidate.track], detections[candidate.spot] );
+	}
+
+	for ( size_t i = 0; i < tracks.size(); i++ )
+	{
+		if ( !trackMatched[i] )
+			tracks[i].misses++;
+	}
+}
+
+/*
+ * Updates a track's filter with a measured spot. The measurement noise comes from the spot's centroid uncertainty.
+ */
+void PredictiveTracker::correct( SpotTrack *t, const Spot &spot )
+{
+	float variance = max( minMeasurementVariance, spot.uncertainty * spot.uncertainty / 2 );
+	setIdentity( t->filter.measurementNoiseCov, Scalar( variance ) );
+
+	Mat measurement = ( Mat_<float>(2, 1) << spot.centre.x, spot.centre.y );
+	t->filter.correct( measurement );
+
+	t->spot = spot;
+	t->spot.id = t->id;
+	t->misses = 0;
+}
+
+/*
+ * Starts a track at a spot that no track was following, standing still
+ */
+void PredictiveTracker::startTrack( const Spot &spot )
+{
+	SpotTrack t;
+	t.id = nextId++;
+	t.spot = spot;
+	t.spot.id = t.id;
+	t.predicted = spot.centre;
+	t.misses = 0;
+
+	t.filter.init( 4, 2, 0, CV_32F );
+	t.filter.transitionMatrix = ( Mat_<float>(4, 4) << 1, 0, 1, 0,
+	                                                   0, 1, 0, 1,
+	                                                   0, 0, 1, 0,
+	                                                   0, 0, 0, 1 );
+	setIdentity( t.filter.measurementMatrix );
+	setIdentity( t.filter.processNoiseCov, Scalar( processNoise ) );
+	setIdentity( t.filter.measurementNoiseCov, Scalar( max( minMeasurementVariance, spot.uncertainty * spot.uncertainty / 2 ) ) );
+
+	t.filter.errorCovPost = ( Mat_<float>(4, 4) << initialPositionVariance, 0, 0, 0,
+	                                               0, initialPositionVariance, 0, 0,
+	                                               0, 0, initialVelocityVariance, 0,
+	                                               0, 0, 0, initialVelocityVariance );
+	t.filter.statePost = ( Mat_<float>(4, 1) << spot.centre.x, spot.centre.y, 0, 0 );
+
+	tracks.push_back( t );
+}
+
+/*
+ * Drops tracks that have missed their spot too many times, notes whether any spot was lost, and leaves the spots measured this
+ * frame in the tracker for drawing and printing.
+ */
+void PredictiveTracker::finishFrame()
+{
+	size_t kept = 0;
+
+	lost = false;
+	tracker->spots.clear();
+
+	for ( size_t i = 0; i < tracks.size(); i++ )
+	{
+		if ( tracks[i].misses > 0 )
+			lost = true;
+
+		if ( tracks[i].misses > maxMisses )
+			continue;
+
+		if ( tracks[i].misses == 0 )
+			tracker->spots.push_back( tracks[i].spot );
+
+		if ( kept != i )
+			tracks[kept] = tracks[i];
+		kept++;
+	}
+
+	tracks.resize( kept );
+
+	if ( !fullPass )
+		tracker->numberOfObjects = tracker->spots.size();
+}
@@ -0,0 +1,87 @@
+/*
+ * PredictiveTracker.h
+ *
+ * Header file for the PredictiveTracker class, which follows the spots found by a SpotTracker from frame to frame with one Kalman
+ * filter per spot. Once the spots are locked, only a small gating window around where each spot is predicted to be is thresholded
+ * and labeled, with a full frame pass on a schedule or whenever a spot is lost.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <opencv/cv.h>
+#include "opencv2/video/tracking.hpp"
+#include "SpotTracker.h"
+#include "SpotAssociator.h"
+#include <vector>
+
+#ifndef PREDICTIVETRACKER_H_
+#define PREDICTIVETRACKER_H_
+
+/*
+ * A spot followed from frame to frame
+ */
+typedef struct SpotTrack
+{
+	int id;
+	Spot spot; // Last spot measured for this track
+	cv::Point2f predicted; // Where the spot is expected to be in the current frame
+	cv::Rect gate; // Window the spot is looked for in
+	int misses; // Frames in a row the spot has not been found
+	cv::KalmanFilter filter; // Constant velocity filter over x, y and their velocities
+} SpotTrack;
+
+class PredictiveTracker {
+public:
+	// Variables
+	int fullPassInterval; // Frames between full frame passes once spots are locked
+	int maxMisses; // Frames a track can go without its spot before it is dropped
+	float gateSigmas; // Half size of the gating window in standard deviations of the predicted position
+	int minGate; // Smallest half size of a gating window in pixels
+	float processNoise; // Variance of the change in a spot's velocity between frames, in pixels squared
+
+	std::vector<SpotTrack> tracks;
+
+	// Results of the last frame tracked
+	long pixelsProcessed; // Pixels thresholded and labeled
+	bool fullPass; // Whether the whole frame was searched
+
+	// Constructors
+	PredictiveTracker( SpotTracker* );
+	~PredictiveTracker();
+
+	// Functions
+	void trackByDifference( const cv::Mat&, const cv::Mat& );
+	void trackByColour( const cv::Mat& );
+	void reset();
+
+private:
+	SpotTracker *tracker; // Pipeline that does the thresholding and labeling, and whose spots are replaced by the tracked spots
+	int framesSinceFullPass;
+	bool lost; // A track missed its spot in the last frame
+	int nextId;
+
+	// A spot found inside a track's gating window, and its squared distance from the track's prediction
+	struct GateCandidate
+	{
+		float distance;
+		int track, spot;
+
+		bool operator<( const GateCandidate &other ) const { return distance < other.distance; }
+	};
+
+	SpatialHash hash;
+	std::vector<bool> detectionUsed, trackMatched;
+	std::vector<int> found;
+	std::vector<GateCandidate> candidates;
+
+	void track( bool, const cv::Mat*, const cv::Mat* );
+	void predict();
+	void associateFullPass();
+	void searchGates( bool );
+	void correct( SpotTrack*, const Spot& );
+	void startTrack( const Spot& );
+	void finishFrame();
+};
+
+#endif /* PREDICTIVETRACKER_H_ */
@@ -0,0 +1,508 @@
+/*
+ * RayBatch.cpp
+ *
+ *	Source file containing the ray batch and its kernels. Each kernel works on four rays at a time with SSE or NEON, with a plain C++
+ *	version for every other processor and for the rays left over at the end of a batch. The operations are done in the same order
+ *	as the Vector3D functions, so dot products, cross products, normalizing and reflecting give exactly the same floats. Rotations
+ *	work in single precision where Vector3D uses double, so they agree to within float rounding.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "RayBatch.h"
+#include <math.h>
+#include <cmath>
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#elif defined( __aarch64__ )
+#include <arm_neon.h>
+#endif
+
+// ================================= Variables ================================= //
+
+// Components of a rotated vector smaller than this are set to 0, the same as the Vector3D rotations
+const float tinyComponent = 0.0000001f;
+
+// ================================= End Variables ================================= //
+
+/*
+ * Four floats worked on at once. NEON is only used on 64 bit ARM, as 32 bit NEON has no division or square root.
+ */
+#if defined( __SSE2__ )
+#define RAY_LANES 4
+typedef __m128 Lanes;
+
+static inline Lanes load( const float *p ) { return _mm_loadu_ps( p ); }
+static inline void store( float *p, Lanes v ) { _mm_storeu_ps( p, v ); }
+static inline Lanes splat( float f ) { return _mm_set1_ps( f ); }
+static inline Lanes add( Lanes a, Lanes b ) { return _mm_add_ps( a, b ); }
+static inline Lanes sub( Lanes a, Lanes b ) { return _mm_sub_ps( a, b ); }
+static inline Lanes mul( Lanes a, Lanes b ) { return _mm_mul_ps( a, b ); }
+static inline Lanes divide( Lanes a, Lanes b ) { return _mm_div_ps( a, b ); }
+static inline Lanes squareRoot( Lanes a ) { return _mm_sqrt_ps( a ); }
+
+// Sets lanes whose magnitude is below 'tiny' to 0
+static inline Lanes clampTiny( Lanes a, Lanes tiny )
+{
+	Lanes magnitude = _mm_andnot_ps( _mm_set1_ps( -0.f ), a );
+	return _mm_andnot_ps( _mm_cmplt_ps( magnitude, tiny ), a );
+}
+#elif defined( __aarch64__ )
+#define RAY_LANES 4
+typedef float32x4_t Lanes;
+
+static inline Lanes load( const float *p ) { return vld1q_f32( p ); }
+static inline void store( float *p, Lanes v ) { vst1q_f32( p, v ); }
+static inline Lanes splat( float f ) { return vdupq_n_f32( f ); }
+static inline Lanes add( Lanes a, Lanes b ) { return vaddq_f32( a, b ); }
+static inline Lanes sub( Lanes a, Lanes b ) { return vsubq_f32( a, b ); }
+static inline Lanes mul( Lanes a, Lanes b ) { return vmulq_f32( a, b ); }
+static inline Lanes divide( Lanes a, Lanes b ) { return vdivq_f32( a, b ); }
+static inline Lanes squareRoot( Lanes a ) { return vsqrtq_f32( a ); }
+
+// Sets lanes whose magnitude is below 'tiny' to 0
+static inline Lanes clampTiny( Lanes a, Lanes tiny )
+{
+	uint32x4_t keep = vcgeq_f32( vabsq_f32( a ), tiny );
+	return vreinterpretq_f32_u32( vandq_u32( vreinterpretq_u32_f32( a ), keep ) );
+}
+#endif
+
+static inline float clampTiny( float f )
+{
+	return ( std::abs( f ) < tinyComponent ? 0 : f );
+}
+
+
+// ===================================================
+// 				RAY BATCH CLASS
+// ===================================================
+
+RayBatch::RayBatch() { }
+
+/*
+ *	Constructor for a batch of 'count' rays, all 0
+ */
+RayBatch::RayBatch( size_t count )
+{
+	resize( count );
+}
+
+RayBatch::~RayBatch() { }
+
+// ============= Functions
+/*
+ *	Changes the number of rays in the batch. Rays added are 0.
+ */
+void RayBatch::resize( size_t count )
+{
+	x.resize( count );
+	y.resize( count );
+	z.resize( count );
+}
+
+/*
+ *	Makes room for 'count' rays, so that resizing the batch up to that many does not allocate
+ */
+void RayBatch::reserve( size_t count )
+{
+	x.reserve( count );
+	y.reserve( count );
+	z.reserve( count );
+}
+
+/*
+ *	Sets ray 'i' of the batch to 'v'
+ */
+void RayBatch::set( size_t i, const Vector3D &v )
+{
+	x[i] = v.p.x;
+	y[i] = v.p.y;
+	z[i] = v.p.z;
+}
+
+/*
+ *	Returns ray 'i' of the batch
+ */
+Vector3D RayBatch::get( size_t i ) const
+{
+	return Vector3D( x[i], y[i], z[i] );
+}
+
+
+// ===================================================
+// 				KERNELS
+// ===================================================
+
+/*
+ * Writes the dot product of each ray of 'a' with the same ray of 'b' into 'result', which must have room for a.size() floats
+ */
+void dotProducts( const RayBatch &a, const RayBatch &b, float *result )
+{
+	const size_t n = a.size();
+	if ( n == 0 ) return;
+
+	const float *ax = &a.x[0], *ay = &a.y[0], *az = &a.z[0];
+	const float *bx = &b.x[0], *by = &b.y[0], *bz = &b.z[0];
+	size_t i = 0;
+
+#ifdef RAY_LANES
+	for ( ; i + RAY_LANES <= n; i += RAY_LANES )
+	{
+		Lanes dot = add( add( mul( load( ax + i ), load( bx + i ) ), mul( load( ay + i ), load( by + i ) ) ),
+		                 mul( load( az + i ), load( bz + i ) ) );
+		store( result + i, dot );
+	}
+#endif
+
+	for ( ; i < n; i++ )
+		result[i] = (ax[i] * bx[i]) + (ay[i] * by[i]) + (az[i] * bz[i]);
+}
+
+/*
+ * Writes the cross product of each ray of 'a' with the same ray of 'b' into 'dest', which may be either of them
+ */
+void crossProducts( const RayBatch &a, const RayBatch &b, RayBatch *dest )
+{
+	const size_t n = a.size();
+	dest->resize( n );
+	if ( n == 0 ) return;
+
+	const float *ax = &a.x[0], *ay = &a.y[0], *az = &a.z[0];
+	const float *bx = &b.x[0], *by = &b.y[0], *bz = &b.z[0];
+	float *dx = &dest->x[0], *dy = &dest->y[0], *dz = &dest->z[0];
+	size_t i = 0;
+
+#ifdef RAY_LANES
+	for ( ; i + RAY_LANES <= n; i += RAY_LANES )
+	{
+		Lanes x1 = load( ax + i ), y1 = load( ay + i ), z1 = load( az + i );
+		Lanes x2 = load( bx + i ), y2 = load( by + i ), z2 = load( bz + i );
+
+		store( dx + i, sub( mul( y1, z2 ), mul( z1, y2 ) ) );
+		store( dy + i, sub( mul( z1, x2 ), mul( x1, z2 ) ) );
+		store( dz + i, sub( mul( x1, y2 ), mul( y1, x2 ) ) );
+	}
+#endif
+
+	for ( ; i < n; i++ )
+	{
+		float x = (ay[i] * bz[i]) - (az[i] * by[i]);
+		float y = (az[i] * bx[i]) - (ax[i] * bz[i]);
+		float z = (ax[i] * by[i]) - (ay[i] * bx[i]);
+
+		dx[i] = x; dy[i] = y; dz[i] = z;
+	}
+}
+
+/*
+ * Normalizes every ray of 'rays' (length one)
+ */
+void normalizeRays( RayBatch *rays )
+{
+	const size_t n = rays->size();
+	if ( n == 0 ) return;
+
+	float *x = &rays->x[0], *y = &rays->y[0], *z = &rays->z[0];
+	size_t i = 0;
+
+#ifdef RAY_LANES
+	for ( ; i + RAY_LANES <= n; i += RAY_LANES )
+	{
+		Lanes vx = load( x + i ), vy = load( y + i ), vz = load( z + i );
+		Lanes l = squareRoot( add( add( mul( vx, vx ), mul( vy, vy ) ), mul( vz, vz ) ) );
+
+		store( x + i, divide( vx, l ) );
+		store( y + i, divide( vy, l ) );
+		store( z + i, divide( vz, l ) );
+	}
+#endif
+
+	for ( ; i < n; i++ )
+	{
+		float l = sqrtf( (x[i] * x[i]) + (y[i] * y[i]) + (z[i] * z[i]) );
+
+		x[i] = x[i] / l;
+		y[i] = y[i] / l;
+		z[i] = z[i] / l;
+	}
+}
+
+/*
+ * Reflects each ray of 'rays' about the same ray of 'normals' into 'dest', which may be 'rays'. The normals need not be normalized.
+ */
+void reflectRays( const RayBatch &rays, const RayBatch &normals, RayBatch *dest )
+{
+	const size_t n = rays.size();
+	dest->resize( n );
+	if ( n == 0 ) return;
+
+	const float *vx = &rays.x[0], *vy = &rays.y[0], *vz = &rays.z[0];
+	const float *nx = &normals.x[0], *ny = &normals.y[0], *nz = &normals.z[0];
+	float *rx = &dest->x[0], *ry = &dest->y[0], *rz = &dest->z[0];
+	size_t i = 0;
+
+#ifdef RAY_LANES
+	const Lanes two = splat( 2.f );
+
+	for ( ; i + RAY_LANES <= n; i += RAY_LANES )
+	{
+		Lanes x = load( nx + i ), y = load( ny + i ), z = load( nz + i );
+		Lanes l = squareRoot( add( add( mul( x, x ), mul( y, y ) ), mul( z, z ) ) );
+		x = divide( x, l ); y = divide( y, l ); z = divide( z, l );
+
+		Lanes v1 = load( vx + i ), v2 = load( vy + i ), v3 = load( vz + i );
+		Lanes dot = add( add( mul( v1, x ), mul( v2, y ) ), mul( v3, z ) );
+
+		// r = v - (2 * ( v dot normal ) * n)
+		store( rx + i, sub( v1, mul( mul( x, dot ), two ) ) );
+		store( ry + i, sub( v2, mul( mul( y, dot ), two ) ) );
+		store( rz + i, sub( v3, mul( mul( z, dot ), two ) ) );
+	}
+#endif
+
+	for ( ; i < n; i++ )
+	{
+		float l = sqrtf( (nx[i] * nx[i]) + (ny[i] * ny[i]) + (nz[i] * nz[i]) );
+		float x = nx[i] / l, y = ny[i] / l, z = nz[i] / l;
+		float dot = (vx[i] * x) + (vy[i] * y) + (vz[i] * z);
+
+		rx[i] = vx[i] - ((x * dot) * 2.f);
+		ry[i] = vy[i] - ((y * dot) * 2.f);
+		rz[i] = vz[i] - ((z * dot) * 2.f);
+	}
+}
+
+/*
+ * Reflects every ray of 'rays' about the one mirror 'normal' into 'dest', which may be 'rays'. The normal is normalized once for
+ * the whole batch rather than once per ray.
+ */
+void reflectRays( const RayBatch &rays, Vector3D normal, RayBatch *dest )
+{
+	const size_t n = rays.size();
+	dest->resize( n );
+	if ( n == 0 ) return;
+
+	normal.normalize();
+
+	const float *vx = &rays.x[0], *vy = &rays.y[0], *vz = &rays.z[0];
+	float *rx = &dest->x[0], *ry = &dest->y[0], *rz = &dest->z[0];
+	size_t i = 0;
+
+#ifdef RAY_LANES
+	const Lanes x = splat( normal.p.x ), y = splat( normal.p.y ), z = splat( normal.p.z ), two = splat( 2.f );
+
+	for ( ; i + RAY_LANES <= n; i += RAY_LANES )
+	{
+		Lanes v1 = load( vx + i ), v2 = load( vy + i ), v3 = load( vz + i );
+		Lanes dot = add( add( mul( v1, x ), mul( v2, y ) ), mul( v3, z ) );
+
+		store( rx + i, sub( v1, mul( mul( x, dot ), two ) ) );
+		store( ry + i, sub( v2, mul( mul( y, dot ), two ) ) );
+		store( rz + i, sub( v3, mul( mul( z, dot ), two ) ) );
+	}
+#endif
+
+	for ( ; i < n; i++ )
+	{
+		float dot = (vx[i] * normal.p.x) + (vy[i] * normal.p.y) + (vz[i] * normal.p.z);
+
+		rx[i] = vx[i] - ((normal.p.x * dot) * 2.f);
+		ry[i] = vy[i] - ((normal.p.y * dot) * 2.f);
+		rz[i] = vz[i] - ((normal.p.z * dot) * 2.f);
+	}
+}
+
+/*
+ * Rotates the 'a' and 'b' components of 'n' rays by an angle with cosine 'c' and sine 's', writing them to 'ra' and 'rb':
+ *	[ ra ] = [ c, -s ] [ a ]
+ *	[ rb ]   [ s,  c ] [ b ]
+ * The component left alone by the rotation is only clamped, into 'rc'. Every output may be the same array as its input.
+ */
+static void rotatePlane( const float *a, const float *b, const float *c0, float *ra, float *rb, float *rc, size_t n, float c, float s )
+{
+	size_t i = 0;
+
+#ifdef RAY_LANES
+	const Lanes cosine = splat( c ), sine = splat( s ), minusSine = splat( -s ), tiny = splat( tinyComponent );
+
+	for ( ; i + RAY_LANES <= n; i += RAY_LANES )
+	{
+		Lanes va = load( a + i ), vb = load( b + i ), vc = load( c0 + i );
+
+		store( ra + i, clampTiny( add( mul( va, cosine ), mul( vb, minusSine ) ), tiny ) );
+		store( rb + i, clampTiny( add( mul( va, sine ), mul( vb, cosine ) ), tiny ) );
+		store( rc + i, clampTiny( vc, tiny ) );
+	}
+#endif
+
+	for ( ; i < n; i++ )
+	{
+		float va = a[i], vb = b[i];
+
+		ra[i] = clampTiny( (va * c) + (vb * -s) );
+		rb[i] = clampTiny( (va * s) + (vb * c) );
+		rc[i] = clampTiny( c0[i] );
+	}
+}
+
+/*
+ * Rotates every ray of 'rays' around the Z axis (yaw) by 'theta' radians into 'dest', which may be 'rays'. Sine and cosine are
+ * worked out once for the whole batch.
+ */
+void rotateRaysYaw( const RayBatch &rays, float theta, RayBatch *dest )
+{
+	dest->resize( rays.size() );
+	if ( rays.size() == 0 ) return;
+
+	rotatePlane( &rays.x[0], &rays.y[0], &rays.z[0], &dest->x[0], &dest->y[0], &dest->z[0], rays.size(),
+	             (float)cos( theta ), (float)sin( theta ) );
+}
+
+/*
+ * Rotates every ray of 'rays' around the X axis (roll) by 'theta' radians into 'dest', which may be 'rays'
+ */
+void rotateRaysRoll( const RayBatch &rays, float theta, RayBatch *dest )
+{
+	dest->resize( rays.size() );
+	if ( rays.size() == 0 ) return;
+
+	rotatePlane( &rays.y[0], &rays.z[0], &rays.x[0], &dest->y[0], &dest->z[0], &dest->x[0], rays.size(),
+	             (float)cos( theta ), (float)sin( theta ) );
+}
+
+/*
+ * Rotates every ray of 'rays' around the Y axis (pitch) by 'theta' radians into 'dest', which may be 'rays'. Around Y the plane
+ * is turned from z towards x.
+ */
+void rotateRaysPitch( const RayBatch &rays, float theta, RayBatch *dest )
+{
+	dest->resize( rays.size() );
+	if ( rays.size() == 0 ) return;
+
+	rotatePlane( &rays.z[0], &rays.x[0], &rays.y[0], &dest->z[0], &dest->x[0], &dest->y[0], rays.size(),
+	             (float)cos( theta ), (float)sin( theta ) );
+}
+
+/*
+ * Multiplies every ray of 'rays' by the row major 3x3 'matrix' into 'dest', which may be 'rays'
+ */
+void transformRays( const RayBatch &rays, const float matrix[3][3], RayBatch *dest )
+{
+	const size_t n = rays.size();
+	dest->resize( n );
+	if ( n == 0 ) return;
+
+	const float *vx = &rays.x[0], *vy = &rays.y[0], *vz = &rays.z[0];
+	float *rx = &dest->x[0], *ry = &dest->y[0], *rz = &dest->z[0];
+	size_t i = 0;
+
+#ifdef RAY_LANES
+	Lanes row[3][3];
+	for ( int r = 0; r < 3; r++ )
+		for ( int c = 0; c < 3; c++ )
+			row[r][c] = splat( matrix[r][c] );
+
+	for ( ; i + RAY_LANES <= n; i += RAY_LANES )
+	{
+		Lanes x = load( vx + i ), y = load( vy + i ), z = load( vz + i );
+
+		store( rx + i, add( add( mul( row[0][0], x ), mul( row[0][1], y ) ), mul( row[0][2], z ) ) );
+		store( ry + i, add( add( mul( row[1][0], x ), mul( row[1][1], y ) ), mul( row[1][2], z ) ) );
+		store( rz + i, add( add( mul( row[2][0], x ), mul( row[2][1], y ) ), mul( row[2][2], z ) ) );
+	}
+#endif
+
+	for ( ; i < n; i++ )
+	{
+		float x = vx[i], y = vy[i], z = vz[i];
+
+		rx[i] = (matrix[0][0] * x) + (matrix[0][1] * y) + (matrix[0][2] * z);
+		ry[i] = (matrix[1][0] * x) + (matrix[1][1] * y) + (matrix[1][2] * z);
+		rz[i] = (matrix[2][0] * x) + (matrix[2][1] * y) + (matrix[2][2] * z);
+	}
+}
+
+/*
+ * For each pair of rays, one from 'originsA' along 'directionsA' and one from 'originsB' along 'directionsB', finds the points
+ * where the two rays pass closest to each other. The point halfway between them goes into 'midpoints' and the distance between
+ * them into 'residuals', which must have room for one float per ray. The directions need not be normalized. Parallel rays have no
+ * single closest point and give a residual that is not finite.
+ */
+void closestPoints( const RayBatch &originsA, const RayBatch &directionsA, const RayBatch &originsB, const RayBatch &directionsB,
+                    RayBatch *midpoints, float *residuals )
+{
+	const size_t n = directionsA.size();
+	midpoints->resize( n );
+	if ( n == 0 ) return;
+
+	const float *px = &originsA.x[0], *py = &originsA.y[0], *pz = &originsA.z[0];
+	const float *ux = &directionsA.x[0], *uy = &directionsA.y[0], *uz = &directionsA.z[0];
+	const float *qx = &originsB.x[0], *qy = &originsB.y[0], *qz = &originsB.z[0];
+	const float *vx = &directionsB.x[0], *vy = &directionsB.y[0], *vz = &directionsB.z[0];
+	float *mx = &midpoints->x[0], *my = &midpoints->y[0], *mz = &midpoints->z[0];
+	size_t i = 0;
+
+	/*
+	 * With w = p - q, the closest points are p + s u and q + t v where
+	 *	s = (b e - c d) / (a c - b b),	t = (a e - b d) / (a c - b b)
+	 * and a = u.u, b = u.v, c = v.v, d = u.w, e = v.w
+	 */
+#ifdef RAY_LANES
+	const Lanes half = splat( 0.5f );
+
+	for ( ; i + RAY_LANES <= n; i += RAY_LANES )
+	{
+		Lanes u1 = load( ux + i ), u2 = load( uy + i ), u3 = load( uz + i );
+		Lanes v1 = load( vx + i ), v2 = load( vy + i ), v3 = load( vz + i );
+		Lanes q1 = load( qx + i ), q2 = load( qy + i ), q3 = load( qz + i );
+		Lanes p1 = load( px + i ), p2 = load( py + i ), p3 = load( pz + i );
+		Lanes w1 = sub( p1, q1 ), w2 = sub( p2, q2 ), w3 = sub( p3, q3 );
+
+		Lanes a = add( add( mul( u1, u1 ), mul( u2, u2 ) ), mul( u3, u3 ) );
+		Lanes b = add( add( mul( u1, v1 ), mul( u2, v2 ) ), mul( u3, v3 ) );
+		Lanes c = add( add( mul( v1, v1 ), mul( v2, v2 ) ), mul( v3, v3 ) );
+		Lanes d = add( add( mul( u1, w1 ), mul( u2, w2 ) ), mul( u3, w3 ) );
+		Lanes e = add( add( mul( v1, w1 ), mul( v2, w2 ) ), mul( v3, w3 ) );
+		Lanes denominator = sub( mul( a, c ), mul( b, b ) );
+
+		Lanes s = divide( sub( mul( b, e ), mul( c, d ) ), denominator );
+		Lanes t = divide( sub( mul( a, e ), mul( b, d ) ), denominator );
+
+		Lanes a1 = add( p1, mul( s, u1 ) ), a2 = add( p2, mul( s, u2 ) ), a3 = add( p3, mul( s, u3 ) );
+		Lanes b1 = add( q1, mul( t, v1 ) ), b2 = add( q2, mul( t, v2 ) ), b3 = add( q3, mul( t, v3 ) );
+		Lanes g1 = sub( a1, b1 ), g2 = sub( a2, b2 ), g3 = sub( a3, b3 );
+
+		store( mx + i, mul( add( a1, b1 ), half ) );
+		store( my + i, mul( add( a2, b2 ), half ) );
+		store( mz + i, mul( add( a3, b3 ), half ) );
+		store( residuals + i, squareRoot( add( add( mul( g1, g1 ), mul( g2, g2 ) ), mul( g3, g3 ) ) ) );
+	}
+#endif
+
+	for ( ; i < n; i++ )
+	{
+		float w1 = px[i] - qx[i], w2 = py[i] - qy[i], w3 = pz[i] - qz[i];
+
+		float a = (ux[i] * ux[i]) + (uy[i] * uy[i]) + (uz[i] * uz[i]);
+		float b = (ux[i] * vx[i]) + (uy[i] * vy[i]) + (uz[i] * vz[i]);
+		float c = (vx[i] * vx[i]) + (vy[i] * vy[i]) + (vz[i] * vz[i]);
+		float d = (ux[i] * w1) + (uy[i] * w2) + (uz[i] * w3);
+		float e = (vx[i] * w1) + (vy[i] * w2) + (vz[i] * w3);
+		float denominator = (a * c) - (b * b);
+
+		float s = ((b * e) - (c * d)) / denominator;
+		float t = ((a * e) - (b * d)) / denominator;
+
+		float a1 = px[i] + (s * ux[i]), a2 = py[i] + (s * uy[i]), a3 = pz[i] + (s * uz[i]);
+		float b1 = qx[i] + (t * vx[i]), b2 = qy[i] + (t * vy[i]), b3 = qz[i] + (t * vz[i]);
+		float g1 = a1 - b1, g2 = a2 - b2, g3 = a3 - b3;
+
+		mx[i] = (a1 + b1) * 0.5f;
+		my[i] = (a2 + b2) * 0.5f;
+		mz[i] = (a3 + b3) * 0.5f;
+		residuals[i] = sqrtf( (g1 * g1) + (g2 * g2) + (g3 * g3) );
+	}
+}
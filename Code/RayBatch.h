@@ -0,0 +1,47 @@
+/*
+ * RayBatch.h
+ *
+ * Header file for batches of rays stored as separate x, y and z arrays, and kernels that work on a whole batch at once. Each kernel
+ * gives the same result as the matching Vector3D function applied to every ray in turn.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "Geometry.h"
+#include <stddef.h>
+#include <vector>
+
+#ifndef RAYBATCH_H_
+#define RAYBATCH_H_
+
+class RayBatch {
+public:
+	// Variables
+	std::vector<float> x, y, z;
+
+	// Constructors
+	RayBatch();
+	RayBatch( size_t );
+	~RayBatch();
+
+	// Functions
+	size_t size() const { return x.size(); }
+	void resize( size_t );
+	void reserve( size_t );
+	void set( size_t, const Vector3D& );
+	Vector3D get( size_t ) const;
+};
+
+void dotProducts( const RayBatch&, const RayBatch&, float* );
+void crossProducts( const RayBatch&, const RayBatch&, RayBatch* );
+void normalizeRays( RayBatch* );
+void reflectRays( const RayBatch&, const RayBatch&, RayBatch* );
+void reflectRays( const RayBatch&, Vector3D, RayBatch* );
+void rotateRaysYaw( const RayBatch&, float, RayBatch* );
+void rotateRaysRoll( const RayBatch&, float, RayBatch* );
+void rotateRaysPitch( const RayBatch&, float, RayBatch* );
+void transformRays( const RayBatch&, const float[3][3], RayBatch* );
+void closestPoints( const RayBatch&, const RayBatch&, const RayBatch&, const RayBatch&, RayBatch*, float* );
+
+#endif /* RAYBATCH_H_ */
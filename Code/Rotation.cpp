@@ -0,0 +1,178 @@
+/*
+ * Rotation.cpp
+ *
+ *	Source file containing quaternions and the rotations built from them.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "Rotation.h"
+#include <math.h>
+#include <iostream>
+using std::cout;
+
+
+// ===================================================
+// 				QUATERNION CLASS
+// ===================================================
+
+/*
+ *	Default Constructor for the quaternion that does not rotate
+ */
+Quaternion::Quaternion()
+{
+	w = 1; x = 0; y = 0; z = 0;
+}
+
+/*
+ *	Constructor for Quaternion class that allows input of w, x, y, z values
+ */
+Quaternion::Quaternion( float qw, float qx, float qy, float qz )
+{
+	w = qw; x = qx; y = qy; z = qz;
+}
+
+Quaternion::~Quaternion() { }
+
+// ============= Functions
+/*
+ *	Returns the conjugate of this quaternion, which for a unit quaternion is the opposite rotation
+ */
+Quaternion Quaternion::conjugate() const
+{
+	return Quaternion( w, -x, -y, -z );
+}
+
+/*
+ *	Normalizes this quaternion (length one)
+ */
+void Quaternion::normalize()
+{
+	float l = sqrtf( (w * w) + (x * x) + (y * y) + (z * z) );
+
+	w = w / l;
+	x = x / l;
+	y = y / l;
+	z = z / l;
+}
+
+/*
+ *	Print out quaternion parameters to console
+ */
+void Quaternion::print() const
+{
+	cout << "(" << w << ", " << x << ", " << y << ", " << z << ")";
+}
+
+// =================================================== Operators
+
+/*
+ *	Hamilton product: rotating by the result is rotating by 'q' then by this quaternion
+ */
+Quaternion Quaternion::operator*( const Quaternion &q ) const
+{
+	return Quaternion( (w * q.w) - (x * q.x) - (y * q.y) - (z * q.z),
+	                   (w * q.x) + (x * q.w) + (y * q.z) - (z * q.y),
+	                   (w * q.y) - (x * q.z) + (y * q.w) + (z * q.x),
+	                   (w * q.z) + (x * q.y) - (y * q.x) + (z * q.w) );
+}
+
+
+// ===================================================
+// 				ROTATION CLASS
+// ===================================================
+
+/*
+ *	Default Constructor for the rotation that leaves vectors as they are
+ */
+Rotation::Rotation()
+{
+	makeMatrix();
+}
+
+/*
+ *	Constructor for the rotation that rolls around X, then pitches around Y, then yaws around Z, each angle in radians. Rotating
+ *	by it is the same as calling rotateRoll, rotatePitch then rotateYaw, but the sines and cosines are only worked out here.
+ */
+Rotation::Rotation( float roll, float pitch, float yaw )
+{
+	double cr = cos( roll / 2.0 ), sr = sin( roll / 2.0 );
+	double cp = cos( pitch / 2.0 ), sp = sin( pitch / 2.0 );
+	double cy = cos( yaw / 2.0 ), sy = sin( yaw / 2.0 );
+
+	// q = yaw * pitch * roll
+	q.w = (float)( cr * cp * cy + sr * sp * sy );
+	q.x = (float)( sr * cp * cy - cr * sp * sy );
+	q.y = (float)( cr * sp * cy + sr * cp * sy );
+	q.z = (float)( cr * cp * sy - sr * sp * cy );
+
+	makeMatrix();
+}
+
+/*
+ *	Constructor for the rotation described by quaternion 'rotation', which is normalized
+ */
+Rotation::Rotation( const Quaternion &rotation )
+{
+	q = rotation;
+	q.normalize();
+	makeMatrix();
+}
+
+Rotation::~Rotation() { }
+
+// ============= Functions
+/*
+ *	Returns the rotation that undoes this one
+ */
+Rotation Rotation::inverse() const
+{
+	return Rotation( q.conjugate() );
+}
+
+/*
+ *	Returns vector 'v' rotated
+ */
+Vector3D Rotation::apply( const Vector3D &v ) const
+{
+	return matrix * v;
+}
+
+/*
+ *	Rotates every ray of 'rays' into 'dest', which may be 'rays'
+ */
+void Rotation::apply( const RayBatch &rays, RayBatch *dest ) const
+{
+	transformRays( rays, matrix.m, dest );
+}
+
+/*
+ *	Print out the rotation matrix to console, one row per line
+ */
+void Rotation::print() const
+{
+	matrix.print();
+}
+
+/*
+ *	Works out the matrix from the quaternion, which must be of length one
+ */
+void Rotation::makeMatrix()
+{
+	double w = q.w, x = q.x, y = q.y, z = q.z;
+
+	matrix = Matrix3D( (float)( 1 - 2 * (y * y + z * z) ), (float)( 2 * (x * y - w * z) ), (float)( 2 * (x * z + w * y) ),
+	                   (float)( 2 * (x * y + w * z) ), (float)( 1 - 2 * (x * x + z * z) ), (float)( 2 * (y * z - w * x) ),
+	                   (float)( 2 * (x * z - w * y) ), (float)( 2 * (y * z + w * x) ), (float)( 1 - 2 * (x * x + y * y) ) );
+}
+
+// =================================================== Operators
+
+/*
+ *	Composes two rotations: rotating by the result is rotating by 'r' then by this rotation
+ */
+Rotation Rotation::operator*( const Rotation &r ) const
+{
+	return Rotation( q * r.q );
+}
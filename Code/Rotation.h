@@ -0,0 +1,65 @@
+/*
+ * Rotation.h
+ *
+ * Header file for rotations built once from Euler angles and kept as both a quaternion and a 3x3 matrix, so that rotations can be
+ * composed exactly and vectors rotated with no trigonometry.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "Geometry.h"
+#include "RayBatch.h"
+
+#ifndef ROTATION_H_
+#define ROTATION_H_
+
+class Quaternion {
+public:
+	// Variables
+	float w, x, y, z;
+
+	// Constructors
+	Quaternion();
+	Quaternion( float, float, float, float );
+	~Quaternion();
+
+	// Operators
+	Quaternion operator*( const Quaternion& ) const;
+
+	// Functions
+	Quaternion conjugate() const;
+	void normalize();
+	void print() const;
+};
+
+/*
+ * A rotation as a unit quaternion and the matrix made from it. Composing works on the quaternions, which are renormalized, so a
+ * long chain of rotations does not drift away from being a rotation.
+ */
+class Rotation {
+public:
+	// Variables
+	Quaternion q;
+	Matrix3D matrix; // rotated = matrix * v
+
+	// Constructors
+	Rotation();
+	Rotation( float, float, float );
+	Rotation( const Quaternion& );
+	~Rotation();
+
+	// Operators
+	Rotation operator*( const Rotation& ) const;
+
+	// Functions
+	Rotation inverse() const;
+	Vector3D apply( const Vector3D& ) const;
+	void apply( const RayBatch&, RayBatch* ) const;
+	void print() const;
+
+private:
+	void makeMatrix();
+};
+
+#endif /* ROTATION_H_ */
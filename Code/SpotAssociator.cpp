@@ -0,0 +1,274 @@
+/*
+ * SpotAssociator.cpp
+ *
+ *	Source file containing the spatial hash used to find nearby spots, and the associator that matches the spots of each frame to
+ *	those of the frame before. New spots are born once they have been seen for a few frames, and spots that go missing for too long
+ *	die.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "SpotAssociator.h"
+#include <algorithm>
+#include <math.h>
+
+using namespace cv;
+using namespace std;
+
+// ================================= Variables ================================= //
+
+// Most grid cells used per spot, so a few spots spread far apart do not make a huge grid
+const int maxCellsPerSpot = 4;
+
+// Weight of the latest movement in a known spot's velocity, so jitter in the centres does not throw the prediction off
+const float velocitySmoothing = 0.5f;
+
+// ================================= End Variables ================================= //
+
+// ===================================================
+// 				SPATIAL HASH CLASS
+// ===================================================
+
+SpatialHash::SpatialHash()
+{
+	spots = NULL;
+	cellSize = 1;
+	originX = originY = 0;
+	cols = rows = 0;
+}
+
+SpatialHash::~SpatialHash() { }
+
+// ============= Functions
+/*
+ * Sorts the centres of 'spotList' into square cells of side 'size'. The list must not change while the hash is queried. If the
+ * spots are spread so widely that there would be too many cells, the cells are made bigger.
+ */
+void SpatialHash::build( const vector<Spot> &spotList, float size )
+{
+	spots = &spotList;
+	cellSize = max( size, 1.f );
+	cols = rows = 0;
+	cellStart.assign( 1, 0 );
+	items.clear();
+
+	if ( spotList.empty() )
+		return;
+
+	float minX = spotList[0].centre.x, maxX = minX;
+	float minY = spotList[0].centre.y, maxY = minY;
+
+	for ( size_t i = 1; i < spotList.size(); i++ )
+	{
+		minX = min( minX, spotList[i].centre.x ); maxX = max( maxX, spotList[i].centre.x );
+		minY = min( minY, spotList[i].centre.y ); maxY = max( maxY, spotList[i].centre.y );
+	}
+
+	originX = minX;
+	originY = minY;
+
+	double maxCells = (double)maxCellsPerSpot * spotList.size();
+	while ( (double)( (int)( ( maxX - minX ) / cellSize ) + 1 ) * ( (int)( ( maxY - minY ) / cellSize ) + 1 ) > maxCells )
+		cellSize *= 2;
+
+	cols = (int)( ( maxX - minX ) / cellSize ) + 1;
+	rows = (int)( ( maxY - minY ) / cellSize ) + 1;
+
+	// Counting sort of the spots by cell
+	cellStart.assign( cols * rows + 1, 0 );
+	cellOf.resize( spotList.size() );
+
+	for ( size_t i = 0; i < spotList.size(); i++ )
+	{
+		cellOf[i] = cellY( spotList[i].centre.y ) * cols + cellX( spotList[i].centre.x );
+		cellStart[ cellOf[i] + 1 ]++;
+	}
+
+	for ( int c = 0; c < cols * rows; c++ )
+		cellStart[c + 1] += cellStart[c];
+
+	items.resize( spotList.size() );
+	cellNext.assign( cellStart.begin(), cellStart.end() - 1 );
+
+	for ( size_t i = 0; i < spotList.size(); i++ )
+		items[ cellNext[ cellOf[i] ]++ ] = i;
+}
+
+/*
+ * Appends to 'result' the index of every spot whose centre is within 'halfWidth' and 'halfHeight' of 'centre'
+ */
+void SpatialHash::query( Point2f centre, float halfWidth, float halfHeight, vector<int> *result ) const
+{
+	if ( cols == 0 )
+		return;
+
+	int x0 = cellX( centre.x - halfWidth ), x1 = cellX( centre.x + halfWidth );
+	int y0 = cellY( centre.y - halfHeight ), y1 = cellY( centre.y + halfHeight );
+
+	for ( int y = y0; y <= y1; y++ )
+	{
+		for ( int c = y * cols + x0; c <= y * cols + x1; c++ )
+		{
+			for ( int k = cellStart[c]; k < cellStart[c + 1]; k++ )
+			{
+				const Point2f &p = (*spots)[ items[k] ].centre;
+
+				if ( fabs( p.x - centre.x ) <= halfWidth && fabs( p.y - centre.y ) <= halfHeight )
+					result->push_back( items[k] );
+			}
+		}
+	}
+}
+
+/*
+ * Returns the column of the cell holding 'x', clamped to the grid
+ */
+int SpatialHash::cellX( float x ) const
+{
+	return min( max( (int)floor( ( x - originX ) / cellSize ), 0 ), cols - 1 );
+}
+
+/*
+ * Returns the row of the cell holding 'y', clamped to the grid
+ */
+int SpatialHash::cellY( float y ) const
+{
+	return min( max( (int)floor( ( y - originY ) / cellSize ), 0 ), rows - 1 );
+}
+
+// ===================================================
+// 				SPOT ASSOCIATOR CLASS
+// ===================================================
+
+/*
+ *	Default Constructor whereby every parameter takes its default value
+ */
+SpotAssociator::SpotAssociator()
+{
+	gateRadius = 10;
+	minHits = 2;
+	maxMisses = 5;
+
+	reset();
+}
+
+SpotAssociator::~SpotAssociator() { }
+
+// ============= Functions
+/*
+ * Gives each spot in 'spots' the identity of the spot it follows on from, by setting its 'id'. Each known spot is matched to a
+ * spot of the same colour class within the gate radius of where it is expected, closest pairs first. Spots that match nothing are
+ * born as new known spots, and get an identity only once they have been seen in 'minHits' frames; until then their 'id' is -1.
+ */
+void SpotAssociator::associate( vector<Spot> *spots )
+{
+	hash.build( *spots, gateRadius );
+
+	// Every pair of known and new spot close enough to match
+	pairs.clear();
+
+	for ( size_t k = 0; k < known.size(); k++ )
+	{
+		Point2f expected = known[k].position + known[k].velocity;
+
+		found.clear();
+		hash.query( expected, gateRadius, gateRadius, &found );
+
+		for ( size_t f = 0; f < found.size(); f++ )
+		{
+			const Spot &spot = (*spots)[ found[f] ];
+			float dx = spot.centre.x - expected.x, dy = spot.centre.y - expected.y;
+			float distance = dx * dx + dy * dy;
+
+			if ( spot.colourClass == known[k].colourClass && distance <= gateRadius * gateRadius )
+			{
+				Pair pair = { distance, (int)k, found[f] };
+				pairs.push_back( pair );
+			}
+		}
+	}
+
+	std::sort( pairs.begin(), pairs.end() );
+
+	knownOfSpot.assign( spots->size(), -1 );
+	knownMatched.assign( known.size(), false );
+
+	for ( size_t p = 0; p < pairs.size(); p++ )
+	{
+		if ( knownMatched[ pairs[p].knownIndex ] || knownOfSpot[ pairs[p].spotIndex ] >= 0 )
+			continue;
+
+		knownMatched[ pairs[p].knownIndex ] = true;
+		knownOfSpot[ pairs[p].spotIndex ] = pairs[p].knownIndex;
+	}
+
+	// Move matched spots on and age the ones not seen
+	for ( size_t k = 0; k < known.size(); k++ )
+	{
+		if ( knownMatched[k] )
+			continue;
+
+		known[k].position += known[k].velocity;
+		known[k].misses++;
+	}
+
+	for ( size_t i = 0; i < spots->size(); i++ )
+	{
+		Spot &spot = (*spots)[i];
+
+		if ( knownOfSpot[i] >= 0 )
+		{
+			KnownSpot &k = known[ knownOfSpot[i] ];
+			Point2f movement = spot.centre - k.position;
+			k.velocity = Point2f( k.velocity.x + velocitySmoothing * ( movement.x - k.velocity.x ),
+			                      k.velocity.y + velocitySmoothing * ( movement.y - k.velocity.y ) );
+			k.position = spot.centre;
+			k.hits++;
+			k.misses = 0;
+			spot.id = ( k.hits >= minHits ? k.id : -1 );
+		}
+		else
+			spot.id = -1;
+	}
+
+	// Spots not seen for too long die, and spots never confirmed die as soon as they are missed
+	kept.clear();
+
+	for ( size_t k = 0; k < known.size(); k++ )
+	{
+		if ( known[k].misses > maxMisses || ( known[k].misses > 0 && known[k].hits < minHits ) )
+			continue;
+
+		kept.push_back( known[k] );
+	}
+
+	known.swap( kept );
+
+	// Spots that follow on from nothing are born
+	for ( size_t i = 0; i < spots->size(); i++ )
+	{
+		if ( knownOfSpot[i] >= 0 )
+			continue;
+
+		KnownSpot k;
+		k.id = nextId++;
+		k.position = (*spots)[i].centre;
+		k.velocity = Point2f( 0, 0 );
+		k.colourClass = (*spots)[i].colourClass;
+		k.hits = 1;
+		k.misses = 0;
+		known.push_back( k );
+
+		if ( minHits <= 1 ) (*spots)[i].id = k.id;
+	}
+}
+
+/*
+ * Forgets every known spot, so the next spots given are all new
+ */
+void SpotAssociator::reset()
+{
+	known.clear();
+	nextId = 0;
+}
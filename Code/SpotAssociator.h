@@ -0,0 +1,96 @@
+/*
+ * SpotAssociator.h
+ *
+ * Header file for giving light spots identities that last from frame to frame. Spots are put into a uniform grid so that each spot
+ * from the last frame only has to be compared with the new spots in the few cells around it, which keeps matching linear in the
+ * number of spots even for grids of thousands of points.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <opencv/cv.h>
+#include "SpotTracker.h"
+#include <vector>
+
+#ifndef SPOTASSOCIATOR_H_
+#define SPOTASSOCIATOR_H_
+
+/*
+ * A uniform grid over the centres of a set of spots, stored as one array of spot indices sorted by cell
+ */
+class SpatialHash {
+public:
+	// Constructors
+	SpatialHash();
+	~SpatialHash();
+
+	// Functions
+	void build( const std::vector<Spot>&, float );
+	void query( cv::Point2f, float, float, std::vector<int>* ) const;
+
+private:
+	const std::vector<Spot> *spots;
+	float cellSize;
+	float originX, originY;
+	int cols, rows;
+	std::vector<int> cellStart; // Index into 'items' of the first spot of each cell, plus one past the end
+	std::vector<int> items; // Spot indices sorted by cell
+	std::vector<int> cellOf; // Cell of each spot
+	std::vector<int> cellNext; // Next free place in 'items' of each cell while sorting
+
+	int cellX( float ) const;
+	int cellY( float ) const;
+};
+
+/*
+ * A spot being followed by the associator
+ */
+typedef struct KnownSpot
+{
+	int id;
+	cv::Point2f position; // Where the spot was last seen, or is expected to be while it is missing
+	cv::Point2f velocity; // Movement per frame
+	int colourClass;
+	int hits; // Frames the spot has been seen in
+	int misses; // Frames in a row the spot has not been seen
+} KnownSpot;
+
+class SpotAssociator {
+public:
+	// Variables
+	float gateRadius; // Furthest a spot can move from where it is expected and keep its identity, in pixels
+	int minHits; // Frames a new spot must be seen in before it is given an identity
+	int maxMisses; // Frames a spot can go unseen before its identity is dropped
+
+	std::vector<KnownSpot> known;
+
+	// Constructors
+	SpotAssociator();
+	~SpotAssociator();
+
+	// Functions
+	void associate( std::vector<Spot>* );
+	void reset();
+
+private:
+	// A spot of the last frame and a spot of this frame close enough to be the same spot
+	struct Pair
+	{
+		float distance;
+		int knownIndex, spotIndex;
+
+		bool operator<( const Pair &other ) const { return distance < other.distance; }
+	};
+
+	SpatialHash hash;
+	int nextId;
+
+	std::vector<Pair> pairs;
+	std::vector<int> found;
+	std::vector<int> knownOfSpot;
+	std::vector<bool> knownMatched;
+	std::vector<KnownSpot> kept;
+};
+
+#endif /* SPOTASSOCIATOR_H_ */
@@ -0,0 +1,1134 @@
+/*
+ * SpotTracker.cpp
+ *
+ *	Source file containing the light spot tracking pipeline: thresholding by frame difference or by colour, cleaning up the
+ *	thresholded image with morphological operations, and finding the centre of each spot.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ *  Algorithms and Code based on tutorials by Kyle Hounslow
+ */
+
+#include "SpotTracker.h"
+#include "MorphOps.h"
+#include "PixelKernels.h"
+#include "Centroid.h"
+#include "HeapCounter.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+using namespace cv;
+using namespace std;
+
+// ================================= Variables ================================= //
+
+// Smallest mask that is labeled in parallel strips rather than on one thread
+const int parallelLabelingMinPixels = 1 << 20;
+
+// Blur kernel the steady state check uses, large enough to be run as a recursive Gaussian
+const int steadyCheckBlur = 15;
+
+// Variance of each background pixel when the background is started, in gray levels squared
+const float initialBackgroundVariance = 25;
+
+// Rows in each strip of the tiled pipeline. Strips are kept small so there are many more of them than cores, and a core that
+// finishes early takes on more.
+const int tileRows = 32;
+
+// What the tiled pipeline does to each strip
+enum TileStage
+{
+	TILE_DIFFERENCE, // Threshold the difference between 'frame' and 'nextFrame' into 'differenceThresholdFrame'
+	TILE_COLOUR, // Threshold 'frame' by the HSV range into 'thresholdFrame'
+	TILE_CLASSES, // Segment 'frame' by the colour classes into 'classFrame'
+	TILE_CLASS // Extract one class of 'classFrame' into 'thresholdFrame'
+};
+
+// Step between the pixels sampled when checking tiles for change
+const int changeSampleStep = 4;
+
+// Pixels of the coarse frame added around each coarse spot to make the full frame window it is confirmed in
+const int refineMargin = 2;
+
+// ================================= End Variables ================================= //
+
+/*
+ * Sets every tracking parameter to its default value
+ */
+TrackingParameters::TrackingParameters()
+{
+	frameScale = 0.2f;
+	coarseScale = 0.2f;
+
+	thresholdSensitivity = 40;
+	streamPairing = PAIR_SLIDING;
+	pairingInterval = 50;
+	backgroundRate = 0.05f;
+	backgroundSigmas = 0;
+	changeTileSize = 16;
+
+	hMin = 0; sMin = 0; vMin = 0;
+	hMax = 179; sMax = 255; vMax = 255;
+
+	erodeSize = 3;
+	dilateSize = 3;
+	blurStrength = 0;
+
+	maxNumberOfObjects = 50;
+	objectAreaMin = 10 * 10;
+	objectAreaMax = 100 * 100;
+
+	blurFrame = true; erodeFrame = true; dilateFrame = true; trackFrame = true;
+	fusedDifference = true;
+	lookupColour = false;
+	binaryMorphology = true;
+	runLabeling = true;
+	subpixelCentroids = true;
+	coarseToFine = false;
+	blockChanges = false;
+	tiledPipeline = false;
+	debugFrames = true;
+}
+
+/*
+ * Loop body used to run the pipeline over strips of the frame on every core at once
+ */
+class TileBody : public ParallelLoopBody
+{
+public:
+	TileBody( SpotTracker *tracker, int stage, int colourClass ) : tracker( tracker ), stage( stage ), colourClass( colourClass ) { }
+
+	void operator()( const Range &range ) const
+	{
+		for ( int i = range.start; i < range.end; i++ )
+			tracker->processTile( i, stage, colourClass );
+	}
+
+private:
+	SpotTracker *tracker;
+	int stage, colourClass;
+};
+
+// ===================================================
+// 				SPOT TRACKER CLASS
+// ===================================================
+
+/*
+ *	Default Constructor whereby every parameter takes its default value
+ */
+SpotTracker::SpotTracker()
+{
+	numberOfObjects = 0;
+	resetStream();
+}
+
+/*
+ *	Constructor for SpotTracker class that allows input of the tracking parameters
+ */
+SpotTracker::SpotTracker( const TrackingParameters &parameters )
+{
+	params = parameters;
+	numberOfObjects = 0;
+	resetStream();
+}
+
+SpotTracker::~SpotTracker() { }
+
+// ============= Functions
+/*
+ * Tracks light spots by looking for pixel differences between 'first' and 'second', which should already be scaled by 'frameScale'.
+ * Both frames are copied into this tracker's own buffers, so the inputs are left untouched.
+ *
+ * When detecting coarse to fine, the threshold images hold the coarse frame and the spots found there are then confirmed and
+ * measured in windows of the full frames.
+ */
+void SpotTracker::trackByDifference( const Mat &first, const Mat &second )
+{
+	loadFrames( first, second );
+
+	spots.clear();
+	numberOfObjects = 0;
+
+	if ( params.blockChanges )
+	{
+		trackChangedBlocks();
+		return;
+	}
+
+	if ( params.coarseToFine )
+	{
+		resize( frame, coarseFrame, Size(), params.coarseScale, params.coarseScale, INTER_AREA );
+		resize( nextFrame, coarseNextFrame, coarseFrame.size(), 0, 0, INTER_AREA );
+
+		thresholdDifference( coarseFrame, coarseNextFrame );
+		cleanThresholdFrame( &differenceThresholdFrame, params.coarseScale );
+
+		if ( params.trackFrame )
+		{
+			findSpots( differenceThresholdFrame, differenceFrame, -1, params.coarseScale );
+			refineSpots( true );
+		}
+		return;
+	}
+
+	if ( params.tiledPipeline )
+	{
+		runTiles( TILE_DIFFERENCE, -1 );
+
+		if ( params.trackFrame )
+			findSpots( differenceThresholdFrame, differenceFrame, -1 );
+		return;
+	}
+
+	thresholdDifference( frame, nextFrame );
+	cleanThresholdFrame( &differenceThresholdFrame );
+
+	// Track objects based on threshold pixels
+	if ( params.trackFrame )
+		findSpots( differenceThresholdFrame, differenceFrame, -1 );
+}
+
+/*
+ * Tracks light spots by finding areas of a particular colour in 'src', which should already be scaled by 'frameScale'. The frame is
+ * copied into this tracker's own buffer, so the input is left untouched. If colour classes are set, spots of every class are found
+ * from a single segmentation pass, and 'thresholdFrame' is left holding the last class.
+ */
+void SpotTracker::trackByColour( const Mat &src )
+{
+	loadFrame( src );
+
+	spots.clear();
+	numberOfObjects = 0;
+
+	// Frame spots are first found in
+	const Mat *detectFrame = &frame;
+	float detectScale = 1;
+
+	if ( params.coarseToFine )
+	{
+		resize( frame, coarseFrame, Size(), params.coarseScale, params.coarseScale, INTER_AREA );
+		detectFrame = &coarseFrame;
+		detectScale = params.coarseScale;
+	}
+	else if ( params.tiledPipeline )
+	{
+		setColourRanges();
+		if ( params.debugFrames ) cvtColor( frame, hsvFrame, CV_BGR2HSV );
+
+		if ( params.subpixelCentroids ) valueFrame( frame, &frameValue );
+
+		if ( !params.colourClasses.empty() )
+		{
+			runTiles( TILE_CLASSES, -1 );
+
+			for ( int k = 0; k < colourTable.numberOfClasses(); k++ )
+			{
+				runTiles( TILE_CLASS, k );
+
+				if ( params.trackFrame )
+					findSpots( thresholdFrame, frameValue, k );
+			}
+
+			// The maximum number of objects is for every class together
+			if ( numberOfObjects >= params.maxNumberOfObjects )
+				spots.clear();
+		}
+		else
+		{
+			runTiles( TILE_COLOUR, -1 );
+
+			if ( params.trackFrame )
+				findSpots( thresholdFrame, frameValue, -1 );
+		}
+		return;
+	}
+
+	if ( params.subpixelCentroids ) valueFrame( *detectFrame, &frameValue );
+
+	if ( !params.colourClasses.empty() )
+	{
+		setColourRanges();
+		colourTable.segmentClasses( *detectFrame, &classFrame );
+
+		if ( params.debugFrames ) cvtColor( *detectFrame, hsvFrame, CV_BGR2HSV );
+
+		for ( int k = 0; k < colourTable.numberOfClasses(); k++ )
+		{
+			ColourTable::extractClass( classFrame, k, &thresholdFrame );
+			cleanThresholdFrame( &thresholdFrame, detectScale );
+
+			if ( params.trackFrame )
+				findSpots( thresholdFrame, frameValue, k, detectScale );
+		}
+
+		// The maximum number of objects is for every class together
+		if ( numberOfObjects >= params.maxNumberOfObjects )
+			spots.clear();
+	}
+	else
+	{
+		thresholdColour( *detectFrame );
+		cleanThresholdFrame( &thresholdFrame, detectScale );
+
+		// Track objects based on threshold pixels
+		if ( params.trackFrame )
+			findSpots( thresholdFrame, frameValue, -1, detectScale );
+	}
+
+	if ( params.coarseToFine && params.trackFrame )
+		refineSpots( false );
+}
+
+/*
+ * Circles every spot found in the last frame on 'image', and writes how many were found. Spots of different colour classes are
+ * circled in different colours.
+ */
+void SpotTracker::drawSpots( Mat *image )
+{
+	static const Scalar classColours[] = { Scalar(0,255,0), Scalar(255,0,255), Scalar(0,255,255), Scalar(255,255,0),
+	                                       Scalar(0,0,255), Scalar(255,0,0), Scalar(0,128,255), Scalar(255,255,255) };
+	std::stringstream ss;
+
+	for ( size_t i = 0; i < spots.size(); i++ )
+		circle( *image, Point( cvRound( spots[i].centre.x ), cvRound( spots[i].centre.y ) ), 10, classColours[ spots[i].colourClass < 0 ? 0 : spots[i].colourClass ], 2);
+
+	// Display how many objects are being tracked
+	if ( numberOfObjects > 0 && numberOfObjects < params.maxNumberOfObjects )
+	{
+		ss << "Spots Found: " << spots.size();
+		putText( *image, ss.str(), Point(10,20), 1, 1, Scalar(0,255,0), 2);
+	}
+}
+
+/*
+ * Tracks light spots by difference in a stream of frames, such as live video, given one at a time. Each frame is copied and
+ * converted to gray only once, and its gray image is kept to be compared with the next frame. Frames are paired up according to
+ * 'streamPairing'; 'timestamp' is when the frame was captured, in milliseconds, and is only needed for PAIR_TIMESTAMP. 'index' is
+ * the frame's number in the stream, if known; PAIR_PARITY then pairs each odd frame only with the even frame just before it, so
+ * the pairs stay in step when frames are dropped. Pairs are tracked by changed tiles or by the tiled pipeline when those are on,
+ * as in trackByDifference.
+ *
+ * Returns true if the frame completed a pair and spots were tracked, in which case 'frame' holds the first frame of the pair and
+ * 'nextFrame' the second. Returns false if the frame is waiting to be paired with the next one.
+ */
+bool SpotTracker::trackStreamFrame( const Mat &src, double timestamp, long index )
+{
+	// The last frame becomes 'frame' and the new one is copied over the buffer of the frame before that
+	std::swap( frame, nextFrame );
+	src.copyTo( nextFrame );
+
+	if ( havePrevious && previousGray.size() != nextFrame.size() )
+		havePrevious = false;
+
+	bool paired;
+
+	if ( params.streamPairing == PAIR_SLIDING )
+		paired = havePrevious;
+	else if ( params.streamPairing == PAIR_PARITY && index >= 0 )
+		paired = havePrevious && index % 2 == 1 && previousIndex == index - 1;
+	else if ( params.streamPairing == PAIR_PARITY )
+		paired = havePrevious && !previousPaired;
+	else
+		paired = havePrevious && !previousPaired && timestamp - previousTimestamp <= params.pairingInterval;
+
+	if ( paired && ( params.blockChanges || params.tiledPipeline ) )
+	{
+		// These work on the colour frames of the pair, which are already in 'frame' and 'nextFrame'
+		spots.clear();
+		numberOfObjects = 0;
+
+		if ( params.blockChanges )
+			trackChangedBlocks();
+		else
+		{
+			runTiles( TILE_DIFFERENCE, -1 );
+
+			if ( params.trackFrame )
+				findSpots( differenceThresholdFrame, differenceFrame, -1 );
+		}
+
+		if ( params.streamPairing == PAIR_SLIDING )
+			grayFrame( nextFrame, &previousGray );
+	}
+	else if ( paired )
+	{
+		// Only a sliding window compares this frame again, so only then is its gray image kept
+		bool keepGray = ( params.streamPairing == PAIR_SLIDING );
+
+		grayDifferenceThreshold( previousGray, nextFrame, params.thresholdSensitivity, &differenceThresholdFrame,
+		                         ( params.debugFrames || params.subpixelCentroids ) ? &differenceFrame : NULL,
+		                         keepGray ? &currentGray : NULL );
+
+		if ( keepGray ) std::swap( previousGray, currentGray );
+
+		cleanThresholdFrame( &differenceThresholdFrame );
+
+		spots.clear();
+		numberOfObjects = 0;
+
+		if ( params.trackFrame )
+			findSpots( differenceThresholdFrame, differenceFrame, -1 );
+	}
+	else
+		grayFrame( nextFrame, &previousGray );
+
+	havePrevious = true;
+	previousPaired = paired;
+	previousTimestamp = timestamp;
+	previousIndex = index;
+	return paired;
+}
+
+/*
+ * Forgets the frames streamed so far, so the next frame streamed starts a new pair
+ */
+void SpotTracker::resetStream()
+{
+	havePrevious = false;
+	previousPaired = false;
+	previousTimestamp = 0;
+	previousIndex = -1;
+}
+
+/*
+ * Tracks light spots by difference between 'src' and a running average of the frames before it, which follows slow changes in
+ * lighting. The background is compared with and updated in the same single pass over the frame. The first frame given, or one of
+ * a new size, starts the background and finds no spots. 'src' is copied into 'nextFrame'.
+ *
+ * Every pixel has to be compared to keep the whole background up to date, so 'blockChanges' and 'tiledPipeline' are not used here.
+ */
+void SpotTracker::trackByBackground( const Mat &src )
+{
+	src.copyTo( nextFrame );
+
+	spots.clear();
+	numberOfObjects = 0;
+
+	if ( backgroundFrame.size() != nextFrame.size() )
+	{
+		grayFrame( nextFrame, &currentGray );
+		currentGray.convertTo( backgroundFrame, CV_32F );
+		backgroundVariance.create( nextFrame.size(), CV_32FC1 );
+		backgroundVariance.setTo( Scalar( initialBackgroundVariance ) );
+
+		differenceThresholdFrame.create( nextFrame.size(), CV_8UC1 );
+		differenceThresholdFrame.setTo( Scalar( 0 ) );
+		differenceFrame.create( nextFrame.size(), CV_8UC1 );
+		differenceFrame.setTo( Scalar( 0 ) );
+		return;
+	}
+
+	backgroundDifferenceThreshold( nextFrame, &backgroundFrame, params.backgroundSigmas > 0 ? &backgroundVariance : NULL,
+	                               params.backgroundRate, params.thresholdSensitivity, params.backgroundSigmas, &differenceThresholdFrame,
+	                               ( params.debugFrames || params.subpixelCentroids ) ? &differenceFrame : NULL );
+
+	cleanThresholdFrame( &differenceThresholdFrame );
+
+	// Track objects based on threshold pixels
+	if ( params.trackFrame )
+		findSpots( differenceThresholdFrame, differenceFrame, -1 );
+}
+
+/*
+ * Forgets the background, so the next frame given to trackByBackground starts it again
+ */
+void SpotTracker::resetBackground()
+{
+	backgroundFrame.release();
+	backgroundVariance.release();
+}
+
+/*
+ * Copies 'first' and 'second' into this tracker's frame buffers for tracking by difference, resizing 'second' to match 'first' if
+ * needed. Spots are not looked for.
+ */
+void SpotTracker::loadFrames( const Mat &first, const Mat &second )
+{
+	first.copyTo( frame );
+
+	if ( second.size() == first.size() )
+		second.copyTo( nextFrame );
+	else
+		resize( second, nextFrame, frame.size() );
+}
+
+/*
+ * Copies 'src' into this tracker's frame buffer for tracking by colour. Spots are not looked for.
+ */
+void SpotTracker::loadFrame( const Mat &src )
+{
+	src.copyTo( frame );
+}
+
+/*
+ * Finds the pixels that differ between 'first' and 'second' and puts the thresholded result into 'differenceThresholdFrame'.
+ * The difference image itself is only kept in 'differenceFrame' when debug frames or subpixel centroids are wanted, or the fused
+ * kernel is not used.
+ */
+void SpotTracker::thresholdDifference( const Mat &first, const Mat &second )
+{
+	// Do the whole conversion, difference and threshold in one pass
+	if ( params.fusedDifference )
+	{
+		differenceThreshold( first, second, params.thresholdSensitivity, &differenceThresholdFrame,
+		                     ( params.debugFrames || params.subpixelCentroids ) ? &differenceFrame : NULL );
+		return;
+	}
+
+	// Convert both frames to gray scale
+	cvtColor( first, frameGray, CV_RGB2GRAY );
+	cvtColor( second, nextFrameGray, CV_RGB2GRAY );
+
+	// Get the absolute different between pixel values in the two images
+	absdiff( frameGray, nextFrameGray, differenceFrame );
+
+	// Threshold the difference image out to get clearer motion
+	threshold( differenceFrame, differenceThresholdFrame, params.thresholdSensitivity, 255, THRESH_BINARY );
+}
+
+/*
+ * Finds the pixels of 'src' that lie inside the HSV range and puts the result into 'thresholdFrame'. When the lookup table is
+ * used, 'hsvFrame' is only produced if debug frames are wanted.
+ */
+void SpotTracker::thresholdColour( const Mat &src )
+{
+	if ( params.lookupColour )
+	{
+		setColourRanges();
+		colourTable.segment( src, &thresholdFrame );
+
+		if ( params.debugFrames ) cvtColor( src, hsvFrame, CV_BGR2HSV );
+		return;
+	}
+
+	// Convert 'src' to HSV colour scheme and put into 'hsvFrame'
+	cvtColor( src, hsvFrame, CV_BGR2HSV );
+
+	// Find pixels from a specific colour range, set those to one and all others to zero
+	inRange( hsvFrame, Scalar(params.hMin, params.sMin, params.vMin), Scalar(params.hMax, params.sMax, params.vMax), thresholdFrame );
+}
+
+/*
+ * Blurs, erodes and dilates a thresholded frame according to the control parameters to get rid of noise. 'scale' is the size of
+ * the frame relative to the frame given to the tracker, and shrinks the kernels to match.
+ *
+ * With binary morphology, every non zero pixel of the (possibly blurred) frame counts as set and the result is 0 or 255. Erosion and
+ * dilation commute with that threshold, so the same pixels end up non zero as with 8 bit morphology.
+ */
+void SpotTracker::cleanThresholdFrame( Mat *threshFrame, float scale )
+{
+	cleanMask( threshFrame, &maskBits, &morphBits, &blurScratch, scale );
+}
+
+/*
+ * Does the work of cleanThresholdFrame, using 'bits' and 'scratchBits' as scratch space for binary morphology and 'blurScratch'
+ * for blurring, so that several masks can be cleaned at once.
+ */
+void SpotTracker::cleanMask( Mat *threshFrame, BitMask *bits, BitMask *scratchBits, Mat *blurScratch, float scale )
+{
+	int blurStrength = scaledKernel( params.blurStrength, scale ) | ( params.blurStrength != 0 );
+	int erodeSize = scaledKernel( params.erodeSize, scale );
+	int dilateSize = scaledKernel( params.dilateSize, scale );
+
+	// Blur image to get rid of noise
+	if ( params.blurFrame && blurStrength != 0 )
+		blurImage( threshFrame, threshFrame, 1, blurStrength, blurScratch );
+
+	bool erodeMask = params.erodeFrame && erodeSize != 0;
+	bool dilateMask = params.dilateFrame && dilateSize != 0;
+
+	if ( params.binaryMorphology && ( erodeMask || dilateMask ) )
+	{
+		bits->pack( *threshFrame );
+
+		if ( erodeMask )
+		{
+			erodeBits( bits, scratchBits, 0, erodeSize );
+			std::swap( *bits, *scratchBits );
+		}
+
+		if ( dilateMask )
+		{
+			dilateBits( bits, scratchBits, 0, dilateSize );
+			std::swap( *bits, *scratchBits );
+		}
+
+		bits->unpack( threshFrame );
+		return;
+	}
+
+	// Erode and Dilate to get rid of noise
+	if ( erodeMask )
+		erodeImage( threshFrame, threshFrame, 0, erodeSize );
+
+	if ( dilateMask )
+		dilateImage( threshFrame, threshFrame, 0, dilateSize );
+}
+
+/*
+ * Finds the centre of every object in a thresholded Matrix that is larger than the minimum object area, and adds it to 'spots' as
+ * belonging to 'colourClass'. The objects are added to 'numberOfObjects', and nothing is found if that total reaches the maximum
+ * number of objects, so with colour classes the maximum is for every class together. 'intensity' is the gray image whose brightness
+ * weights subpixel centres: the difference image when tracking by difference, or the HSV value when tracking by colour.
+ *
+ * 'scale' is the size of 'threshFrame' relative to the frame given to the tracker, and shrinks the object area limits to match.
+ *
+ * The blob labeler measures objects by their number of pixels and also drops objects larger than the maximum object area. The
+ * contour path measures the area inside each outline, which is a little smaller. Both count every object of any size towards the
+ * maximum number of objects, but the contour path also counts each hole inside an object, so a noisy mask reaches the maximum
+ * sooner there than with the labeler.
+ */
+void SpotTracker::findSpots( const Mat &threshFrame, const Mat &intensity, int colourClass, float scale )
+{
+	int objects;
+	int areaMin = cvFloor( params.objectAreaMin * scale * scale );
+	int areaMax = cvCeil( params.objectAreaMax * scale * scale );
+
+	if ( params.runLabeling )
+	{
+		blobs.clear();
+
+		if ( params.tiledPipeline || (int)threshFrame.total() >= parallelLabelingMinPixels )
+			objects = labeler.labelParallel( threshFrame, areaMin, areaMax, &blobs );
+		else
+			objects = labeler.label( threshFrame, areaMin, areaMax, &blobs );
+
+		numberOfObjects += objects;
+
+		if ( objects > 0 && numberOfObjects < params.maxNumberOfObjects )
+		{
+			for ( size_t i = 0; i < blobs.size(); i++ )
+				addSpot( threshFrame, intensity, blobs[i].box, blobs[i].m10 / blobs[i].area, blobs[i].m01 / blobs[i].area,
+				         blobs[i].area, colourClass );
+		}
+		return;
+	}
+
+	// findContours modifies its input, so work on a copy
+	threshFrame.copyTo( contourFrame );
+
+	// Get contours of pixels set to one in thresholded image.
+	findContours( contourFrame, contours, contourHierarchy, CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE );
+
+	objects = contourHierarchy.size();
+	numberOfObjects += objects;
+
+	// Assuming that the only objects left in the thresholded image are what we want, track them all.
+	if ( objects > 0 && numberOfObjects < params.maxNumberOfObjects )
+	{
+		for ( int index = 0; index >= 0; index = contourHierarchy[index][0] )
+		{
+			// Get area from contour object
+			Moments moment = moments((cv::Mat)contours[index]);
+			double area = moment.m00;
+
+			if ( area > areaMin )
+				addSpot( threshFrame, intensity, boundingRect( contours[index] ), moment.m10/area, moment.m01/area, area, colourClass );
+		}
+	}
+}
+
+/*
+ * Adds a spot with its binary centre at ('x', 'y') and its pixels inside 'box' to 'spots'. With subpixel centroids, the centre is
+ * moved to the brightness weighted centre of the spot in 'intensity' and given an uncertainty.
+ */
+void SpotTracker::addSpot( const Mat &threshFrame, const Mat &intensity, const Rect &box, double x, double y, double area, int colourClass )
+{
+	Spot spot;
+	spot.centre = Point2f( (float)x, (float)y );
+	spot.uncertainty = 0;
+	spot.area = area;
+	spot.box = box;
+	spot.id = -1;
+	spot.colourClass = colourClass;
+
+	if ( params.subpixelCentroids && !intensity.empty() )
+		refineCentroid( intensity, threshFrame, box, &spot.centre, &spot.uncertainty );
+
+	spots.push_back( spot );
+}
+
+/*
+ * Confirms each spot found in the coarse frame by thresholding, cleaning and labeling a window of the full frame around it, and
+ * replaces it with the spots found there. A coarse spot with nothing in its window is dropped, and one that turns out to be several
+ * spots close together is split. Only the windows are processed, so the cost grows with the number of spots rather than with the
+ * size of the frame.
+ */
+void SpotTracker::refineSpots( bool byDifference )
+{
+	Rect bounds( 0, 0, frame.cols, frame.rows );
+	float toFull = 1 / params.coarseScale;
+	int margin = cvCeil( refineMargin * toFull );
+
+	candidates.swap( spots );
+	spots.clear();
+	searchWindows.clear();
+
+	for ( size_t i = 0; i < candidates.size(); i++ )
+	{
+		const Spot &candidate = candidates[i];
+
+		// The coarse spot's box in full frame pixels, and the window around it
+		SearchWindow search;
+		search.box = Rect( cvFloor( candidate.box.x * toFull ), cvFloor( candidate.box.y * toFull ),
+		                   cvCeil( candidate.box.width * toFull ), cvCeil( candidate.box.height * toFull ) );
+		search.window = Rect( search.box.x - margin, search.box.y - margin, search.box.width + 2 * margin,
+		                      search.box.height + 2 * margin ) & bounds;
+		search.colourClass = candidate.colourClass;
+		searchWindows.push_back( search );
+	}
+
+	// Spots close together give overlapping windows, which would each find the same spots
+	mergeSearchWindows();
+
+	for ( size_t i = 0; i < searchWindows.size(); i++ )
+		findSpotsInWindow( searchWindows[i].window, searchWindows[i].box, byDifference, searchWindows[i].colourClass );
+}
+
+/*
+ * Joins the search windows that overlap, and have the same colour class, into one window covering both, with a box covering both
+ * of their boxes. No pixel is then in more than one window, so no blob is labeled twice.
+ */
+void SpotTracker::mergeSearchWindows()
+{
+	bool merged = true;
+
+	while ( merged )
+	{
+		merged = false;
+
+		for ( size_t i = 0; i < searchWindows.size(); i++ )
+		{
+			for ( size_t j = i + 1; j < searchWindows.size(); j++ )
+			{
+				SearchWindow &a = searchWindows[i], &b = searchWindows[j];
+
+				if ( a.colourClass != b.colourClass || ( a.window & b.window ).area() == 0 )
+					continue;
+
+				a.window = a.window | b.window;
+				a.box = a.box | b.box;
+				searchWindows[j] = searchWindows.back();
+				searchWindows.pop_back();
+				merged = true;
+				j--;
+			}
+		}
+	}
+}
+
+/*
+ * Tracks by difference only in the parts of the frame that have changed. Each tile of the frame is checked cheaply for change
+ * first, then changed tiles and the tiles around them are grouped together, and only the bounding rectangle of each group plus a
+ * halo wide enough for the blur and morphology goes through the full pipeline. A frame with no changed tiles finishes straight
+ * away. The threshold images are only filled in, with the pixels processed, when debug frames are wanted.
+ */
+void SpotTracker::trackChangedBlocks()
+{
+	int tile = params.changeTileSize;
+	int changedTiles = blockChanges( frame, nextFrame, tile, changeSampleStep, params.thresholdSensitivity / 2, &tileFrame );
+
+	if ( params.debugFrames )
+	{
+		differenceThresholdFrame.create( frame.size(), CV_8UC1 );
+		differenceThresholdFrame.setTo( Scalar( 0 ) );
+		differenceFrame.create( frame.size(), CV_8UC1 );
+		differenceFrame.setTo( Scalar( 0 ) );
+	}
+
+	if ( changedTiles == 0 || !params.trackFrame )
+		return;
+
+	// Take in the tiles next to changed ones, so spots across a tile edge are found whole. The mask bits are free until the windows
+	// are cleaned, and keep their words between frames where dilateBinary would allocate its own.
+	maskBits.pack( tileFrame );
+	dilateBits( &maskBits, &morphBits, 0, 3 );
+	morphBits.unpack( &tileFrame );
+	tileRegions.clear();
+	labeler.label( tileFrame, 0, tileFrame.total(), &tileRegions );
+
+	int halo = pipelineHalo();
+	Rect bounds( 0, 0, frame.cols, frame.rows );
+
+	searchWindows.clear();
+
+	for ( size_t i = 0; i < tileRegions.size(); i++ )
+	{
+		const Rect &r = tileRegions[i].box;
+
+		SearchWindow search;
+		search.box = Rect( r.x * tile, r.y * tile, r.width * tile, r.height * tile ) & bounds;
+		search.window = Rect( search.box.x - halo, search.box.y - halo, search.box.width + 2 * halo,
+		                      search.box.height + 2 * halo ) & bounds;
+		search.colourClass = -1;
+		searchWindows.push_back( search );
+	}
+
+	// The boxes of separate regions can overlap, and would then both find the spots where they do
+	mergeSearchWindows();
+
+	for ( size_t i = 0; i < searchWindows.size(); i++ )
+	{
+		const Rect &window = searchWindows[i].window;
+
+		findSpotsInWindow( window, searchWindows[i].box, true, -1 );
+
+		if ( params.debugFrames )
+		{
+			Mat maskWindow = differenceThresholdFrame( window ), differenceWindow = differenceFrame( window );
+			windowMask.copyTo( maskWindow );
+			windowDifference.copyTo( differenceWindow );
+		}
+	}
+
+	numberOfObjects = spots.size();
+
+	if ( numberOfObjects >= params.maxNumberOfObjects )
+		spots.clear();
+}
+
+/*
+ * Points 'view' at the top left 'size' pixels of 'buffer', growing the buffer only when the window is bigger than any before it
+ */
+void SpotTracker::windowView( Mat *buffer, Mat *view, Size size, int type )
+{
+	if ( buffer->type() != type || buffer->cols < size.width || buffer->rows < size.height )
+		buffer->create( std::max( buffer->rows, size.height ), std::max( buffer->cols, size.width ), type );
+
+	*view = (*buffer)( Rect( 0, 0, size.width, size.height ) );
+}
+
+/*
+ * Puts a pointer to every image this tracker keeps between frames into 'buffers', so a caller can check that they are reused
+ * rather than reallocated. The list changes when the tiled pipeline adds scratch space for more strips.
+ */
+void SpotTracker::listBuffers( std::vector<Mat*> *buffers )
+{
+	Mat* const kept[] = { &frame, &nextFrame, &frameGray, &nextFrameGray, &hsvFrame, &frameValue, &thresholdFrame, &classFrame, &differenceFrame,
+	                      &differenceThresholdFrame, &coarseFrame, &coarseNextFrame, &backgroundFrame, &backgroundVariance, &tileFrame,
+	                      &previousGray, &currentGray, &windowMaskBuffer, &windowDifferenceBuffer, &windowClassesBuffer,
+	                      &windowHSVBuffer, &windowValueBuffer, &contourFrame, &blurScratch };
+
+	buffers->insert( buffers->end(), kept, kept + sizeof( kept ) / sizeof( kept[0] ) );
+
+	for ( size_t i = 0; i < tileScratch.size(); i++ )
+	{
+		buffers->push_back( &tileScratch[i].mask );
+		buffers->push_back( &tileScratch[i].difference );
+		buffers->push_back( &tileScratch[i].hsv );
+		buffers->push_back( &tileScratch[i].blur );
+	}
+}
+
+/*
+ * Returns kernel size 'size' shrunk by 'scale' for a downscaled frame, keeping kernels that are on at least 1
+ */
+int SpotTracker::scaledKernel( int size, float scale )
+{
+	if ( size == 0 || scale == 1 )
+		return size;
+
+	return std::max( 1, cvRound( size * scale ) );
+}
+
+/*
+ * Returns how many pixels the blur and morphology can reach in from outside a window of the frame, so a window grown by this much
+ * gives the same cleaned pixels inside it as the whole frame would. The whole blur kernel is allowed for rather than its radius, as
+ * large Gaussian kernels are run as a recursive filter whose reach only fades away. Erosion and dilation with a size of k use a
+ * kernel of 2k + 1 pixels, so each reaches k pixels.
+ */
+int SpotTracker::pipelineHalo() const
+{
+	int halo = 1;
+
+	if ( params.blurFrame ) halo += params.blurStrength;
+	if ( params.erodeFrame ) halo += params.erodeSize;
+	if ( params.dilateFrame ) halo += params.dilateSize;
+
+	return halo;
+}
+
+/*
+ * Runs one stage of the pipeline over the frame in strips of 'tileRows' rows, on every core at once. Each strip is processed with
+ * a halo of rows above and below it, so the strips put together are the same as processing the frame whole. 'colourClass' is the
+ * class extracted by TILE_CLASS.
+ */
+void SpotTracker::runTiles( int stage, int colourClass )
+{
+	int tiles = ( frame.rows + tileRows - 1 ) / tileRows;
+
+	if ( stage == TILE_DIFFERENCE )
+	{
+		differenceThresholdFrame.create( frame.size(), CV_8UC1 );
+		if ( params.debugFrames || params.subpixelCentroids ) differenceFrame.create( frame.size(), CV_8UC1 );
+	}
+	else if ( stage == TILE_CLASSES )
+		classFrame.create( frame.size(), CV_8UC1 );
+	else
+		thresholdFrame.create( frame.size(), CV_8UC1 );
+
+	tileHalo = pipelineHalo();
+	if ( (int)tileScratch.size() < tiles ) tileScratch.resize( tiles );
+
+	parallel_for_( Range( 0, tiles ), TileBody( this, stage, colourClass ) );
+}
+
+/*
+ * Runs one stage of the pipeline over strip 'tile' of the frame. The strip and its halo are thresholded and cleaned in the
+ * strip's own scratch space, then only the strip's rows are copied into the frame sized result.
+ */
+void SpotTracker::processTile( int tile, int stage, int colourClass )
+{
+	int y0 = tile * tileRows, y1 = std::min( y0 + tileRows, frame.rows );
+
+	// Segmenting by class looks at each pixel alone, so needs no halo and can write straight into the result
+	if ( stage == TILE_CLASSES )
+	{
+		Mat classRows = classFrame.rowRange( y0, y1 );
+		colourTable.segmentClasses( frame.rowRange( y0, y1 ), &classRows );
+		return;
+	}
+
+	int w0 = std::max( 0, y0 - tileHalo ), w1 = std::min( frame.rows, y1 + tileHalo );
+	TileScratch &s = tileScratch[tile];
+	bool keepDifference = ( stage == TILE_DIFFERENCE && ( params.debugFrames || params.subpixelCentroids ) );
+	Mat *result = &thresholdFrame;
+
+	if ( stage == TILE_DIFFERENCE )
+	{
+		differenceThreshold( frame.rowRange( w0, w1 ), nextFrame.rowRange( w0, w1 ), params.thresholdSensitivity, &s.mask,
+		                     keepDifference ? &s.difference : NULL );
+		result = &differenceThresholdFrame;
+	}
+	else if ( stage == TILE_CLASS )
+		ColourTable::extractClass( classFrame.rowRange( w0, w1 ), colourClass, &s.mask );
+	else if ( params.lookupColour )
+		colourTable.segment( frame.rowRange( w0, w1 ), &s.mask );
+	else
+	{
+		cvtColor( frame.rowRange( w0, w1 ), s.hsv, CV_BGR2HSV );
+		inRange( s.hsv, Scalar(params.hMin, params.sMin, params.vMin), Scalar(params.hMax, params.sMax, params.vMax), s.mask );
+	}
+
+	cleanMask( &s.mask, &s.maskBits, &s.morphBits, &s.blur );
+
+	Mat resultRows = result->rowRange( y0, y1 );
+	s.mask.rowRange( y0 - w0, y1 - w0 ).copyTo( resultRows );
+
+	if ( keepDifference )
+	{
+		Mat differenceRows = differenceFrame.rowRange( y0, y1 );
+		s.difference.rowRange( y0 - w0, y1 - w0 ).copyTo( differenceRows );
+	}
+}
+
+/*
+ * Thresholds, cleans and labels only the pixels of 'window' in the loaded frames, and adds the spots found whose centres lie inside
+ * 'box' to 'spots', in frame pixels. 'colourClass' picks the colour class looked for when tracking by colour with colour classes.
+ * The full object area limits are used and the maximum number of objects is not checked.
+ */
+void SpotTracker::findSpotsInWindow( const Rect &window, const Rect &box, bool byDifference, int colourClass )
+{
+	if ( window.area() == 0 )
+		return;
+
+	Mat windowFrame = frame( window );
+	Mat intensity;
+
+	// Windows differ in size, so the images of each window are views of buffers that only grow
+	windowView( &windowMaskBuffer, &windowMask, window.size(), CV_8UC1 );
+
+	if ( byDifference )
+	{
+		windowView( &windowDifferenceBuffer, &windowDifference, window.size(), CV_8UC1 );
+		differenceThreshold( windowFrame, nextFrame( window ), params.thresholdSensitivity, &windowMask, &windowDifference );
+		intensity = windowDifference;
+	}
+	else if ( !params.colourClasses.empty() )
+	{
+		setColourRanges();
+		windowView( &windowClassesBuffer, &windowClasses, window.size(), CV_8UC1 );
+		colourTable.segmentClasses( windowFrame, &windowClasses );
+		ColourTable::extractClass( windowClasses, colourClass < 0 ? 0 : colourClass, &windowMask );
+	}
+	else if ( params.lookupColour )
+	{
+		setColourRanges();
+		colourTable.segment( windowFrame, &windowMask );
+	}
+	else
+	{
+		windowView( &windowHSVBuffer, &windowHSV, window.size(), CV_8UC3 );
+		cvtColor( windowFrame, windowHSV, CV_BGR2HSV );
+		inRange( windowHSV, Scalar(params.hMin, params.sMin, params.vMin), Scalar(params.hMax, params.sMax, params.vMax), windowMask );
+	}
+
+	// Spots found by colour are weighted by their HSV value, the brightness their colour range was given in
+	if ( !byDifference && params.subpixelCentroids )
+	{
+		windowView( &windowValueBuffer, &windowValue, window.size(), CV_8UC1 );
+		valueFrame( windowFrame, &windowValue );
+		intensity = windowValue;
+	}
+
+	cleanThresholdFrame( &windowMask );
+
+	blobs.clear();
+	labeler.label( windowMask, params.objectAreaMin, params.objectAreaMax, &blobs );
+
+	for ( size_t j = 0; j < blobs.size(); j++ )
+	{
+		double x = blobs[j].m10 / blobs[j].area, y = blobs[j].m01 / blobs[j].area;
+
+		// Spots centred outside the box belong to a neighbouring window
+		if ( x + window.x < box.x || x + window.x >= box.x + box.width || y + window.y < box.y || y + window.y >= box.y + box.height )
+			continue;
+
+		addSpot( windowMask, intensity, blobs[j].box, x, y, blobs[j].area, colourClass );
+
+		// Move the spot from window to frame pixels
+		Spot &spot = spots.back();
+		spot.centre.x += window.x;
+		spot.centre.y += window.y;
+		spot.box.x += window.x;
+		spot.box.y += window.y;
+	}
+}
+
+/*
+ * Gives the colour table the colour classes, or the single HSV range if there are none. The table is only rebuilt if they changed.
+ * Colour classes are always segmented with the table, so it keeps every bit of each channel unless a quantised table was asked for.
+ */
+void SpotTracker::setColourRanges()
+{
+	colourTable.setBits( params.lookupColour ? 6 : 8 );
+
+	if ( !params.colourClasses.empty() )
+	{
+		colourTable.setRanges( params.colourClasses );
+		return;
+	}
+
+	HSVRange range = { params.hMin, params.sMin, params.vMin, params.hMax, params.sMax, params.vMax };
+	colourTable.setRange( range );
+}
+
+/*
+ * Returns true if spot 'a' comes before spot 'b' in reading order, so the spots of two trackers can be compared one by one
+ */
+static bool spotBefore( const Spot &a, const Spot &b )
+{
+	if ( a.centre.y != b.centre.y ) return a.centre.y < b.centre.y;
+	return a.centre.x < b.centre.x;
+}
+
+/*
+ * Checks the tiled pipeline against the single threaded one. 'first' and 'second' are tracked by difference with 'params', once
+ * with the frame in strips and once whole; if 'second' is empty, 'first' is tracked by colour instead. Coarse to fine detection
+ * and changed blocks are turned off for both. Returns true if both find the same number of spots, with the same areas and their
+ * centres within 'tolerance' pixels of each other.
+ */
+bool checkTiledPipeline( const TrackingParameters &params, const Mat &first, const Mat &second, float tolerance )
+{
+	TrackingParameters wholeParams = params;
+	wholeParams.coarseToFine = false;
+	wholeParams.blockChanges = false;
+	wholeParams.tiledPipeline = false;
+
+	TrackingParameters tiledParams = wholeParams;
+	tiledParams.tiledPipeline = true;
+
+	SpotTracker whole( wholeParams ), tiled( tiledParams );
+
+	if ( second.empty() )
+	{
+		whole.trackByColour( first );
+		tiled.trackByColour( first );
+	}
+	else
+	{
+		whole.trackByDifference( first, second );
+		tiled.trackByDifference( first, second );
+	}
+
+	if ( whole.spots.size() != tiled.spots.size() )
+		return false;
+
+	std::sort( whole.spots.begin(), whole.spots.end(), spotBefore );
+	std::sort( tiled.spots.begin(), tiled.spots.end(), spotBefore );
+
+	for ( size_t i = 0; i < whole.spots.size(); i++ )
+	{
+		const Spot &a = whole.spots[i], &b = tiled.spots[i];
+
+		if ( a.area != b.area || fabs( a.centre.x - b.centre.x ) > tolerance || fabs( a.centre.y - b.centre.y ) > tolerance )
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Checks that a tracker stops allocating once its buffers have settled. 'first' and 'second' are tracked by difference, then 'first'
+ * by colour through HSV and through the lookup table, each by a new tracker with 'params' but with a blur large enough to be run as
+ * a recursive Gaussian. Each tracker warms up on the frames, then tracks them a few more times while operator new is counted and
+ * its buffers are watched. If 'second' is empty only the colour paths are checked. Returns true if nothing was allocated and no
+ * buffer moved, and puts the number of allocations into 'allocations' if it is given.
+ */
+bool checkSteadyTracking( const TrackingParameters &params, const Mat &first, const Mat &second, long long *allocations )
+{
+	const int warmUpLoops = 2, loops = 3;
+
+	TrackingParameters steadyParams = params;
+	steadyParams.blurFrame = true;
+	steadyParams.blurStrength = std::max( params.blurStrength, steadyCheckBlur ) | 1;
+
+	std::vector<Mat*> buffers;
+	std::vector<const uchar*> data;
+	long long count = 0;
+	bool moved = false;
+
+	// Tracking by difference, by colour through HSV, then by colour through the lookup table
+	for ( int mode = ( second.empty() ? 1 : 0 ); mode < 3; mode++ )
+	{
+		steadyParams.lookupColour = ( mode == 2 );
+		SpotTracker tracker( steadyParams );
+		long long start = 0;
+
+		for ( int i = 0; i < warmUpLoops + loops; i++ )
+		{
+			if ( i == warmUpLoops )
+			{
+				buffers.clear();
+				tracker.listBuffers( &buffers );
+
+				data.clear();
+				for ( size_t j = 0; j < buffers.size(); j++ )
+					data.push_back( buffers[j]->data );
+
+				start = heapAllocations();
+			}
+
+			if ( mode == 0 )
+				tracker.trackByDifference( first, second );
+			else
+				tracker.trackByColour( first );
+		}
+
+		count += heapAllocations() - start;
+
+		buffers.clear();
+		tracker.listBuffers( &buffers );
+
+		if ( buffers.size() != data.size() )
+			moved = true;
+
+		for ( size_t j = 0; j < buffers.size() && j < data.size(); j++ )
+			if ( buffers[j]->data != data[j] ) moved = true;
+	}
+
+	if ( allocations ) *allocations = count;
+	return count == 0 && !moved;
+}
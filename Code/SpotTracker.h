@@ -0,0 +1,207 @@
+/*
+ * SpotTracker.h
+ *
+ * Header file for the SpotTracker class, which owns the buffers and parameters of one light spot tracking pipeline. Each instance
+ * is independent of every other, so several pipelines can run at once on different threads or cameras.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "ColourTable.h"
+#include "MorphOps.h"
+#include "BlobLabeler.h"
+#include <vector>
+
+#ifndef SPOTTRACKER_H_
+#define SPOTTRACKER_H_
+
+/*
+ * A light spot found in a frame
+ */
+typedef struct Spot
+{
+	cv::Point2f centre; // Subpixel centre in pixels of the frame given to the tracker
+	float uncertainty; // Standard error of the centre in pixels, or 0 when the centre was not refined
+	double area;
+	cv::Rect box; // Bounding box of the spot's pixels
+	int id; // Identity that lasts from frame to frame, or -1 if the spot has not been identified
+	int colourClass; // Index of the colour class the spot was found in, or -1 when tracking by difference or by one colour range
+} Spot;
+
+/*
+ * How frames given to a tracker one at a time are paired up for tracking by difference
+ */
+enum StreamPairing
+{
+	PAIR_SLIDING, // Every frame is compared with the frame before it
+	PAIR_PARITY, // Frames are compared in pairs, such as projector off then on, so each frame is in exactly one pair
+	PAIR_TIMESTAMP // As PAIR_PARITY, but a frame only pairs with the one before it if it came within the pairing interval
+};
+
+/*
+ * The parameters that control a tracking pipeline. These are plain ints and bools so that trackbars can point straight at them.
+ */
+struct TrackingParameters
+{
+	// Scale applied to every frame when it is loaded, before it is given to the tracker
+	float frameScale;
+
+	// Scale of the frame spots are first found in when detecting coarse to fine, relative to the frame given to the tracker
+	float coarseScale;
+
+	// Motion Thresholding Parameters
+	int thresholdSensitivity;
+	int streamPairing; // A StreamPairing, for frames given one at a time
+	double pairingInterval; // Longest time between two frames of a pair in milliseconds, for PAIR_TIMESTAMP; 1.5 frames at 30 fps
+	float backgroundRate; // How far the background moves towards each new frame, from 0 to 1
+	float backgroundSigmas; // Standard deviations from the background a pixel must also differ by, or 0 to not keep a variance
+	int changeTileSize; // Side of the tiles checked for change before tracking by difference, in pixels
+
+	// HSV Thresholding Parameters
+	int hMin, sMin, vMin;
+	int hMax, sMax, vMax;
+	std::vector<HSVRange> colourClasses; // If not empty, spots of each of these colours are found instead of the range above, with
+	                                     // the colour table; it is quantised like 'lookupColour' only when that is on
+
+	// Morphological Operation Parameters
+	int erodeSize, dilateSize, blurStrength;
+
+	// Tracking Parameters
+	int maxNumberOfObjects;
+	int objectAreaMin, objectAreaMax;
+
+	// Control Parameters
+	bool blurFrame, erodeFrame, dilateFrame, trackFrame;
+	bool fusedDifference; // Use the single pass gray / difference / threshold kernel
+	bool lookupColour; // Segment by colour with a lookup table instead of converting to HSV; the table is quantised, so off by default
+	bool binaryMorphology; // Erode and dilate bit packed masks instead of 8 bit images
+	bool runLabeling; // Find spots with the single pass blob labeler instead of contours
+	bool subpixelCentroids; // Weight each spot's centre by pixel brightness instead of using the binary centre
+	bool coarseToFine; // Find spots in a downscaled frame, then confirm and measure each one in a window of the full frame
+	bool blockChanges; // Only track by difference in the tiles of the frame that have changed, and the tiles around them
+	bool tiledPipeline; // Threshold and clean strips of the frame on every core at once, for full size frames
+	bool debugFrames; // Keep intermediate images that are only needed for display
+
+	TrackingParameters();
+};
+
+class SpotTracker {
+public:
+	// Variables
+	TrackingParameters params;
+
+	// Matrices to store frames
+	cv::Mat frame, nextFrame; // Copies of the frames tracked; nextFrame for motion tracking comparison
+	cv::Mat frameGray, nextFrameGray; // Gray frames for motion tracking
+	cv::Mat hsvFrame; // Matrix to store HSV colour conversion
+	cv::Mat frameValue; // HSV value of the frame tracked by colour, whose brightness weights subpixel centres
+	cv::Mat thresholdFrame; // Matrix to store thresholded HSV image
+	cv::Mat classFrame; // Matrix to store the colour classes of each pixel, one bit per class
+	cv::Mat differenceFrame; // Matrix to store pixel differences between two frames
+	cv::Mat differenceThresholdFrame; // Matrix to store thresholded difference image
+	cv::Mat coarseFrame, coarseNextFrame; // Downscaled frames spots are first found in when detecting coarse to fine
+	cv::Mat backgroundFrame, backgroundVariance; // Running average gray background and its variance, as floats
+	cv::Mat tileFrame; // One pixel per tile of the frame, set where the tile has changed
+
+	// Results of the last frame tracked
+	int numberOfObjects;
+	std::vector<Spot> spots;
+
+	// Constructors
+	SpotTracker();
+	SpotTracker( const TrackingParameters& );
+	~SpotTracker();
+
+	// Functions
+	void trackByDifference( const cv::Mat&, const cv::Mat& );
+	void trackByColour( const cv::Mat& );
+	void drawSpots( cv::Mat* );
+
+	// Tracking by difference on frames given one at a time, such as live video
+	bool trackStreamFrame( const cv::Mat&, double timestamp = 0, long index = -1 );
+	void resetStream();
+	void trackByBackground( const cv::Mat& );
+	void resetBackground();
+
+	// Window by window tracking, for callers that already know roughly where the spots are
+	void loadFrames( const cv::Mat&, const cv::Mat& );
+	void loadFrame( const cv::Mat& );
+	void findSpotsInWindow( const cv::Rect&, const cv::Rect&, bool, int );
+
+	// Every image kept between frames, for checking that they are reused
+	void listBuffers( std::vector<cv::Mat*>* );
+
+private:
+	// The parallel loop body thresholds and cleans one strip of the frame at a time
+	friend class TileBody;
+
+	// Colour segmentation table, rebuilt when the HSV range or the number of bits changes
+	ColourTable colourTable;
+
+	// Bit packed masks for binary morphology, and the float image of a large blur, kept between frames
+	BitMask maskBits, morphBits;
+	cv::Mat blurScratch;
+
+	// Blob labeler and the blobs it found, kept between frames
+	BlobLabeler labeler;
+	std::vector<Blob> blobs;
+
+	// Gray images of streamed frames, so each frame is converted only once
+	cv::Mat previousGray, currentGray;
+	bool havePrevious; // 'previousGray' holds the last frame streamed
+	bool previousPaired; // The last frame streamed was the second of a pair
+	double previousTimestamp;
+	long previousIndex;
+
+	// A window of the frame to search for spots, keeping those centred in 'box'
+	struct SearchWindow
+	{
+		cv::Rect window, box;
+		int colourClass;
+	};
+
+	// Scratch space for confirming coarse spots in windows of the full frame, kept between frames
+	std::vector<Spot> candidates;
+	std::vector<Blob> tileRegions;
+	std::vector<SearchWindow> searchWindows;
+
+	// Scratch space for each strip of the tiled pipeline, kept between frames
+	struct TileScratch
+	{
+		cv::Mat mask, difference, hsv, blur;
+		BitMask maskBits, morphBits;
+	};
+	std::vector<TileScratch> tileScratch;
+	int tileHalo;
+	cv::Mat windowMask, windowDifference, windowClasses, windowHSV, windowValue; // Views of the top left of the buffers below
+	cv::Mat windowMaskBuffer, windowDifferenceBuffer, windowClassesBuffer, windowHSVBuffer, windowValueBuffer;
+
+	// Scratch space for finding contours, kept between frames
+	cv::Mat contourFrame;
+	std::vector< std::vector<cv::Point> > contours;
+	std::vector<cv::Vec4i> contourHierarchy;
+
+	void thresholdDifference( const cv::Mat&, const cv::Mat& );
+	void thresholdColour( const cv::Mat& );
+	void cleanThresholdFrame( cv::Mat*, float scale = 1 );
+	void cleanMask( cv::Mat*, BitMask*, BitMask*, cv::Mat*, float scale = 1 );
+	static int scaledKernel( int, float );
+	static void windowView( cv::Mat*, cv::Mat*, cv::Size, int );
+	int pipelineHalo() const;
+	void runTiles( int, int );
+	void processTile( int, int, int );
+	void findSpots( const cv::Mat&, const cv::Mat&, int, float scale = 1 );
+	void refineSpots( bool );
+	void mergeSearchWindows();
+	void trackChangedBlocks();
+	void setColourRanges();
+	void addSpot( const cv::Mat&, const cv::Mat&, const cv::Rect&, double, double, double, int );
+};
+
+bool checkTiledPipeline( const TrackingParameters&, const cv::Mat&, const cv::Mat&, float tolerance = 0.01f );
+bool checkSteadyTracking( const TrackingParameters&, const cv::Mat&, const cv::Mat&, long long *allocations = NULL );
+
+#endif /* SPOTTRACKER_H_ */
@@ -0,0 +1,222 @@
+/*
+ * Triangulation.cpp
+ *
+ *	Source file containing the triangulator, which gathers the camera and projector rays of a frame's matched spots into batches and
+ *	finds where each pair passes closest with the closestPoints ray kernel.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "Triangulation.h"
+#include "HeapCounter.h"
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+// ================================= Variables ================================= //
+
+// How far the mean latency moves towards each new frame's latency
+const double triangulationSmoothing = 0.1;
+
+// ================================= End Variables ================================= //
+
+
+// ===================================================
+// ================= TRIANGULATOR ====================
+// ===================================================
+
+Triangulator::Triangulator()
+{
+	camera.focalX = camera.focalY = 1;
+	camera.centreX = camera.centreY = 0;
+	maxResidual = 0;
+	lastLatency = meanLatency = maxLatency = 0;
+	frames = 0;
+}
+
+Triangulator::~Triangulator() { }
+
+// ============= Functions
+/*
+ * Sets the ray of each point of the projected pattern, from 'origins' along 'directions' in world axes. After a mirror the rays no
+ * longer share an origin, so each has its own. The buffers for a frame are sized so that a frame with up to one spot per pattern
+ * point does not allocate.
+ */
+void Triangulator::setProjectorRays( const RayBatch &origins, const RayBatch &directions )
+{
+	assert( origins.size() == directions.size() );
+
+	projectorOrigins = origins;
+	projectorDirections = directions;
+	reserve( directions.size() );
+}
+
+/*
+ * Makes room for 'count' matched spots a frame
+ */
+void Triangulator::reserve( size_t count )
+{
+	cameraOrigins.reserve( count );
+	cameraDirections.reserve( count );
+	matchedOrigins.reserve( count );
+	matchedDirections.reserve( count );
+	midpoints.reserve( count );
+	residuals.reserve( count );
+	matchedSpots.reserve( count );
+	points.reserve( count );
+}
+
+/*
+ * Places in space every spot centre of 'spots' that has been matched to a pattern point. 'patternPoints' holds the index of the
+ * projector ray of each spot, or -1 where a spot has no match. Spot centres are in pixels of a frame scaled by 'scale' from the
+ * full size frame the camera was calibrated with, with pixel centres at whole numbers in both. The points go into 'points' and how
+ * many there are is returned.
+ */
+int Triangulator::triangulate( const vector<Point2D> &spots, const vector<int> &patternPoints, float scale )
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	const size_t patternCount = projectorDirections.size();
+	size_t n = 0;
+
+	// Sized for every spot, then cut down to those matched, so the batches only allocate when they first grow
+	cameraOrigins.resize( spots.size() );
+	cameraDirections.resize( spots.size() );
+	matchedOrigins.resize( spots.size() );
+	matchedDirections.resize( spots.size() );
+	matchedSpots.resize( spots.size() );
+
+	for ( size_t i = 0; i < spots.size() && i < patternPoints.size(); i++ )
+	{
+		int k = patternPoints[i];
+		if ( k < 0 || k >= (int)patternCount )
+			continue;
+
+		// Direction through the spot in the camera's axes; turned into world axes for the whole batch below. The edges of the
+		// scaled frame's pixels line up with the full size frame's, not their centres.
+		cameraOrigins.set( n, camera.origin );
+		cameraDirections.x[n] = ( ( spots[i].x + 0.5f ) / scale - 0.5f - camera.centreX ) / camera.focalX;
+		cameraDirections.y[n] = ( ( spots[i].y + 0.5f ) / scale - 0.5f - camera.centreY ) / camera.focalY;
+		cameraDirections.z[n] = 1;
+
+		matchedOrigins.x[n] = projectorOrigins.x[k];
+		matchedOrigins.y[n] = projectorOrigins.y[k];
+		matchedOrigins.z[n] = projectorOrigins.z[k];
+		matchedDirections.x[n] = projectorDirections.x[k];
+		matchedDirections.y[n] = projectorDirections.y[k];
+		matchedDirections.z[n] = projectorDirections.z[k];
+
+		matchedSpots[n] = i;
+		n++;
+	}
+
+	cameraOrigins.resize( n );
+	cameraDirections.resize( n );
+	matchedOrigins.resize( n );
+	matchedDirections.resize( n );
+	residuals.resize( n );
+
+	points.clear();
+
+	if ( n > 0 )
+	{
+		camera.orientation.apply( cameraDirections, &cameraDirections );
+		closestPoints( cameraOrigins, cameraDirections, matchedOrigins, matchedDirections, &midpoints, &residuals[0] );
+
+		for ( size_t k = 0; k < n; k++ )
+		{
+			// Parallel rays do not meet anywhere
+			if ( !std::isfinite( residuals[k] ) || ( maxResidual > 0 && residuals[k] > maxResidual ) )
+				continue;
+
+			TriangulatedPoint point;
+			point.position = midpoints.get( k );
+			point.residual = residuals[k];
+			point.spot = matchedSpots[k];
+			point.patternPoint = patternPoints[ matchedSpots[k] ];
+			points.push_back( point );
+		}
+	}
+
+	lastLatency = chrono::duration<double, milli>( chrono::steady_clock::now() - start ).count();
+	meanLatency = ( frames == 0 ? lastLatency : meanLatency + triangulationSmoothing * ( lastLatency - meanLatency ) );
+	maxLatency = std::max( maxLatency, lastLatency );
+	frames++;
+
+	return points.size();
+}
+
+
+/*
+ * Function to test the triangulator with a made up camera and projector. Grids of pattern points on a wavy surface are projected
+ * into the camera to make spots, the spots are triangulated and the points found are compared with the surface. Reports the
+ * largest error, the latency and whether a frame allocated once the buffers were sized.
+ */
+void testTriangulation()
+{
+	const int sides[] = { 3, 6, 32, 128 }; // 9 and 36 spot patterns, and two denser ones
+	const int repeats = 100;
+
+	Triangulator triangulator;
+	triangulator.camera.origin = Vector3D( 0, 0, 0 );
+	triangulator.camera.focalX = triangulator.camera.focalY = 800;
+	triangulator.camera.centreX = 320;
+	triangulator.camera.centreY = 240;
+
+	// Projector 100 units to the right of the camera
+	Vector3D projector( 100, 0, 0 );
+
+	for ( size_t s = 0; s < sizeof( sides ) / sizeof( sides[0] ); s++ )
+	{
+		const int side = sides[s];
+		const int count = side * side;
+
+		RayBatch origins( count ), directions( count );
+		vector<Vector3D> surface( count );
+		vector<Point2D> spots( count );
+		vector<int> patternPoints( count );
+
+		for ( int i = 0; i < count; i++ )
+		{
+			float u = ( i % side + 0.5f ) / side - 0.5f, v = ( i / side + 0.5f ) / side - 0.5f;
+			surface[i] = Vector3D( 400 * u, 300 * v, 1000 + 50 * sinf( 6 * u ) * cosf( 4 * v ) );
+
+			origins.set( i, projector );
+			directions.set( i, surface[i] - projector );
+
+			Point2D spot = { 800 * surface[i].p.x / surface[i].p.z + 320, 800 * surface[i].p.y / surface[i].p.z + 240 };
+
+			// Spots are listed in the opposite order to the pattern
+			spots[count - 1 - i] = spot;
+			patternPoints[count - 1 - i] = i;
+		}
+
+		triangulator.setProjectorRays( origins, directions );
+		triangulator.triangulate( spots, patternPoints );
+		triangulator.maxLatency = 0;
+		triangulator.frames = 0;
+
+		long long allocations = heapAllocations();
+		for ( int r = 0; r < repeats; r++ )
+			triangulator.triangulate( spots, patternPoints );
+		allocations = heapAllocations() - allocations;
+
+		float error = 0, residual = 0;
+		for ( size_t k = 0; k < triangulator.points.size(); k++ )
+		{
+			const TriangulatedPoint &point = triangulator.points[k];
+			error = std::max( error, ( point.position - surface[ point.patternPoint ] ).length() );
+			residual = std::max( residual, point.residual );
+		}
+
+		cout << count << " spots: \t" << triangulator.points.size() << " points, largest error " << error << ", largest residual "
+		     << residual << ", " << triangulator.meanLatency * 1000 << " us mean, " << triangulator.maxLatency * 1000 << " us max, "
+		     << allocations << " allocations" << endl;
+	}
+}
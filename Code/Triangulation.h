@@ -0,0 +1,78 @@
+/*
+ * Triangulation.h
+ *
+ * Header file for turning the spots found in a frame into points in space, by intersecting the ray from the camera through each
+ * spot with the ray of the projector that lit it. Every spot of a frame is intersected in one batch. Spots are given by their
+ * centres alone, so the geometry code does not need OpenCV.
+ *
+ * This is a library step: the tracking loop in main does not call it, as there is no calibrated camera or projector pattern to
+ * give it yet. Until there is, only testTriangulation runs it, with a made up camera and projector.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "Geometry.h"
+#include "RayBatch.h"
+#include "Rotation.h"
+#include <vector>
+
+#ifndef TRIANGULATION_H_
+#define TRIANGULATION_H_
+
+/*
+ * A calibrated pinhole camera. Its own axes are x to the right of the image, y down the image and z out along the optical axis.
+ */
+struct CameraModel
+{
+	Vector3D origin; // Centre of projection
+	Rotation orientation; // Turns directions from the camera's axes into world axes
+	float focalX, focalY; // Focal lengths in pixels of a full size frame
+	float centreX, centreY; // Principal point in pixels of a full size frame
+};
+
+/*
+ * A spot placed in space
+ */
+struct TriangulatedPoint
+{
+	Vector3D position; // Halfway between the camera and projector rays where they pass closest
+	float residual; // Distance between the two rays where they pass closest
+	int spot; // Index of the spot in the frame's list of spot centres
+	int patternPoint; // Index of the projector ray the spot was matched with
+};
+
+class Triangulator {
+public:
+	// Variables
+	CameraModel camera;
+	float maxResidual; // Points whose rays pass further apart than this are dropped, or 0 to keep every point
+	std::vector<TriangulatedPoint> points; // Points of the last frame
+
+	// Time taken to triangulate a frame in milliseconds: the last frame, a smoothed mean and the slowest
+	double lastLatency, meanLatency, maxLatency;
+	int frames;
+
+	// Constructors
+	Triangulator();
+	~Triangulator();
+
+	// Functions
+	void setProjectorRays( const RayBatch&, const RayBatch& );
+	size_t patternSize() const { return projectorDirections.size(); }
+	void reserve( size_t );
+	int triangulate( const std::vector<Point2D>&, const std::vector<int>&, float scale = 1 );
+
+private:
+	// One ray per point of the projected pattern, in world axes
+	RayBatch projectorOrigins, projectorDirections;
+
+	// The rays of the matched spots of a frame, gathered into batches
+	RayBatch cameraOrigins, cameraDirections, matchedOrigins, matchedDirections, midpoints;
+	std::vector<float> residuals;
+	std::vector<int> matchedSpots;
+};
+
+void testTriangulation();
+
+#endif /* TRIANGULATION_H_ */
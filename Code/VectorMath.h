@@ -0,0 +1,293 @@
+/*
+ * VectorMath.h
+ *
+ * Header only 3D vector and 3x3 matrix templates, for float, double or fixed point components. Everything is defined here so it
+ * can be inlined into the loops that use it, and the arithmetic is constexpr so that vectors and matrices built from constants,
+ * such as a rotation by a fixed angle, are worked out by the compiler.
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <cmath>
+#include <iostream>
+
+#ifndef VECTORMATH_H_
+#define VECTORMATH_H_
+
+/*
+ * A signed fixed point number with 'FractionBits' bits after the binary point, held in 32 bits. Products and quotients are worked
+ * out in 64 bits. Results too big to hold, including dividing by zero, saturate at the largest value of the right sign rather than
+ * wrapping, and a NaN becomes 0. With 16 fraction bits values must stay below 32768, so squares, and the lengths of vectors found
+ * from them, are only right up to about 181.
+ */
+template <int FractionBits>
+class Fixed {
+public:
+	// Variables
+	int32_t raw;
+
+	// Constructors
+	constexpr Fixed() : raw( 0 ) { }
+	constexpr Fixed( double d ) : raw( fromScaled( d * ( 1 << FractionBits ) ) ) { }
+
+	static constexpr Fixed fromRaw( int32_t r ) { return Fixed( r, 0 ); }
+
+	// Operators
+	constexpr Fixed operator-() const { return fromRaw( saturate( -(int64_t)raw ) ); }
+	constexpr Fixed operator+( Fixed f ) const { return fromRaw( saturate( (int64_t)raw + f.raw ) ); }
+	constexpr Fixed operator-( Fixed f ) const { return fromRaw( saturate( (int64_t)raw - f.raw ) ); }
+	constexpr Fixed operator*( Fixed f ) const { return fromRaw( saturate( ( (int64_t)raw * f.raw ) >> FractionBits ) ); }
+	constexpr Fixed operator/( Fixed f ) const
+	{
+		return f.raw == 0 ? fromRaw( raw < 0 ? INT32_MIN : INT32_MAX )
+		                  : fromRaw( saturate( (int64_t)raw * ( (int64_t)1 << FractionBits ) / f.raw ) );
+	}
+	constexpr bool operator==( Fixed f ) const { return raw == f.raw; }
+	constexpr bool operator!=( Fixed f ) const { return raw != f.raw; }
+	constexpr bool operator<( Fixed f ) const { return raw < f.raw; }
+	constexpr bool operator>( Fixed f ) const { return raw > f.raw; }
+
+	// Functions
+	constexpr double toDouble() const { return (double)raw / ( 1 << FractionBits ); }
+
+private:
+	constexpr Fixed( int32_t r, int ) : raw( r ) { }
+
+	static constexpr int32_t saturate( int64_t r )
+	{
+		return r > INT32_MAX ? INT32_MAX : r < INT32_MIN ? INT32_MIN : (int32_t)r;
+	}
+
+	// Rounds a value already multiplied up by the fraction bits to the nearest raw value
+	static constexpr int32_t fromScaled( double scaled )
+	{
+		return scaled != scaled ? 0 : scaled >= INT32_MAX ? INT32_MAX : scaled <= INT32_MIN ? INT32_MIN
+		                                                  : (int32_t)( scaled + ( scaled < 0 ? -0.5 : 0.5 ) );
+	}
+};
+
+// Found by argument dependent lookup, so the vector templates can call these the same way for every component type
+template <int F> inline Fixed<F> sqrt( Fixed<F> f ) { return Fixed<F>( ::sqrt( f.toDouble() ) ); }
+template <int F> inline Fixed<F> cos( Fixed<F> f ) { return Fixed<F>( ::cos( f.toDouble() ) ); }
+template <int F> inline Fixed<F> sin( Fixed<F> f ) { return Fixed<F>( ::sin( f.toDouble() ) ); }
+template <int F> constexpr Fixed<F> abs( Fixed<F> f ) { return f.raw < 0 ? -f : f; }
+template <int F> inline std::ostream& operator<<( std::ostream &out, Fixed<F> f ) { return out << f.toDouble(); }
+
+template <typename T>
+struct Point2
+{
+	T x, y;
+
+	constexpr Point2 operator+( Point2 p ) const { return Point2{ x + p.x, y + p.y }; }
+	constexpr Point2 operator-( Point2 p ) const { return Point2{ x - p.x, y - p.y }; }
+	constexpr Point2 operator*( T s ) const { return Point2{ x * s, y * s }; }
+};
+
+template <typename T>
+struct Point3
+{
+	T x, y, z;
+};
+
+template <typename T>
+class Vec3 {
+public:
+	// Variables
+	Point3<T> p;
+
+	// Constructors
+	constexpr Vec3() : p{ T(0), T(0), T(0) } { }
+	constexpr Vec3( T x, T y, T z ) : p{ x, y, z } { }
+
+	// Operators
+	constexpr Vec3 operator-() const { return Vec3( -p.x, -p.y, -p.z ); }
+	constexpr Vec3 operator*( T scale ) const { return Vec3( p.x * scale, p.y * scale, p.z * scale ); }
+	constexpr Vec3 operator/( T scale ) const { return Vec3( p.x / scale, p.y / scale, p.z / scale ); }
+	constexpr Vec3 operator-( const Vec3 &v ) const { return Vec3( p.x - v.p.x, p.y - v.p.y, p.z - v.p.z ); }
+	constexpr Vec3 operator+( const Vec3 &v ) const { return Vec3( p.x + v.p.x, p.y + v.p.y, p.z + v.p.z ); }
+	constexpr bool operator==( const Vec3 &v ) const { return ( p.x == v.p.x && p.y == v.p.y && p.z == v.p.z ); }
+	constexpr bool operator!=( const Vec3 &v ) const { return ( p.x != v.p.x || p.y != v.p.y || p.z != v.p.z ); }
+
+	// Functions
+	/*
+	 *	Returns dot product of this vector and argument vector 'v'
+	 */
+	constexpr T dotProduct( const Vec3 &v ) const
+	{
+		return (p.x * v.p.x) + (p.y * v.p.y) + (p.z * v.p.z);
+	}
+
+	/*
+	 *	Returns cross product of this vector and argument vector 'v'
+	 */
+	constexpr Vec3 crossProduct( const Vec3 &v ) const
+	{
+		return Vec3( (p.y * v.p.z) - (p.z * v.p.y), (p.z * v.p.x) - (p.x * v.p.z), (p.x * v.p.y) - (p.y * v.p.x) );
+	}
+
+	/*
+	 *	Returns length of this vector
+	 */
+	T length() const
+	{
+		using std::sqrt;
+		return sqrt( (p.x * p.x) + (p.y * p.y) + (p.z * p.z) );
+	}
+
+	/*
+	 *	Normalizes this vector (length one)
+	 */
+	void normalize()
+	{
+		T l = length();
+
+		p.x = p.x / l;
+		p.y = p.y / l;
+		p.z = p.z / l;
+	}
+
+	/*
+	 *	Returns normalized version of this vector (length one)
+	 */
+	Vec3 getNormalized() const
+	{
+		Vec3 v = *this;
+		v.normalize();
+		return v;
+	}
+
+	/*
+	 *	Returns this vector reflected about vector 'normal', which need not be normalized
+	 */
+	Vec3 reflect( Vec3 normal ) const
+	{
+		normal.normalize();
+
+		// r = v - (2 * ( v dot normal ) * n)
+		return *this - ((normal * dotProduct( normal )) * T(2));
+	}
+
+	/*
+	 *  Rotate vector around Z axis (yaw) by 'theta' radians and return resulting Vector
+	 */
+	Vec3 rotateYaw( T theta ) const
+	{
+		using std::cos; using std::sin;
+		T c = cos( theta ), s = sin( theta );
+
+		return Vec3( (p.x * c) + (p.y * -s), (p.x * s) + (p.y * c), p.z ).clampTiny();
+	}
+
+	/*
+	 *  Rotate vector around X axis (roll) by 'theta' radians and return resulting Vector
+	 */
+	Vec3 rotateRoll( T theta ) const
+	{
+		using std::cos; using std::sin;
+		T c = cos( theta ), s = sin( theta );
+
+		return Vec3( p.x, (p.y * c) + (p.z * -s), (p.y * s) + (p.z * c) ).clampTiny();
+	}
+
+	/*
+	 *  Rotate vector around Y axis (pitch) by 'theta' radians and return resulting Vector
+	 */
+	Vec3 rotatePitch( T theta ) const
+	{
+		using std::cos; using std::sin;
+		T c = cos( theta ), s = sin( theta );
+
+		return Vec3( (p.x * c) + (p.z * s), p.y, (p.x * -s) + (p.z * c) ).clampTiny();
+	}
+
+	/*
+	 *	Print out vector parameters to console
+	 */
+	void print() const
+	{
+		std::cout << "(" << p.x << ", " << p.y << ", " << p.z << ")";
+	}
+
+private:
+	// Returns this vector with components too small to matter after a rotation set to 0
+	Vec3 clampTiny() const
+	{
+		using std::abs;
+		const T tiny = T(0.0000001);
+
+		return Vec3( abs( p.x ) < tiny ? T(0) : p.x, abs( p.y ) < tiny ? T(0) : p.y, abs( p.z ) < tiny ? T(0) : p.z );
+	}
+};
+
+/*
+ * A 3x3 matrix stored by rows, so that m[r][c] is row r, column c
+ */
+template <typename T>
+class Mat3 {
+public:
+	// Variables
+	T m[3][3];
+
+	// Constructors
+	constexpr Mat3() : m{ { T(1), T(0), T(0) }, { T(0), T(1), T(0) }, { T(0), T(0), T(1) } } { }
+	constexpr Mat3( T m00, T m01, T m02, T m10, T m11, T m12, T m20, T m21, T m22 )
+		: m{ { m00, m01, m02 }, { m10, m11, m12 }, { m20, m21, m22 } } { }
+
+	/*
+	 * Rotations about each axis from the cosine and sine of the angle, matching Vec3's rotateRoll, rotatePitch and rotateYaw. With
+	 * constant arguments these, and their products, are worked out at compile time.
+	 */
+	static constexpr Mat3 roll( T c, T s ) { return Mat3( T(1), T(0), T(0), T(0), c, -s, T(0), s, c ); }
+	static constexpr Mat3 pitch( T c, T s ) { return Mat3( c, T(0), s, T(0), T(1), T(0), -s, T(0), c ); }
+	static constexpr Mat3 yaw( T c, T s ) { return Mat3( c, -s, T(0), s, c, T(0), T(0), T(0), T(1) ); }
+
+	// Operators
+	constexpr Vec3<T> operator*( const Vec3<T> &v ) const
+	{
+		return Vec3<T>( (m[0][0] * v.p.x) + (m[0][1] * v.p.y) + (m[0][2] * v.p.z),
+		                (m[1][0] * v.p.x) + (m[1][1] * v.p.y) + (m[1][2] * v.p.z),
+		                (m[2][0] * v.p.x) + (m[2][1] * v.p.y) + (m[2][2] * v.p.z) );
+	}
+
+	constexpr Mat3 operator*( const Mat3 &b ) const
+	{
+		return Mat3( row( 0 ).dotProduct( b.column( 0 ) ), row( 0 ).dotProduct( b.column( 1 ) ), row( 0 ).dotProduct( b.column( 2 ) ),
+		             row( 1 ).dotProduct( b.column( 0 ) ), row( 1 ).dotProduct( b.column( 1 ) ), row( 1 ).dotProduct( b.column( 2 ) ),
+		             row( 2 ).dotProduct( b.column( 0 ) ), row( 2 ).dotProduct( b.column( 1 ) ), row( 2 ).dotProduct( b.column( 2 ) ) );
+	}
+
+	// Functions
+	constexpr Vec3<T> row( int r ) const { return Vec3<T>( m[r][0], m[r][1], m[r][2] ); }
+	constexpr Vec3<T> column( int c ) const { return Vec3<T>( m[0][c], m[1][c], m[2][c] ); }
+
+	/*
+	 *	Returns the transpose, which for a rotation is the opposite rotation
+	 */
+	constexpr Mat3 transpose() const
+	{
+		return Mat3( m[0][0], m[1][0], m[2][0], m[0][1], m[1][1], m[2][1], m[0][2], m[1][2], m[2][2] );
+	}
+
+	/*
+	 *	Print out the matrix to console, one row per line
+	 */
+	void print() const
+	{
+		for ( int r = 0; r < 3; r++ )
+			std::cout << "[ " << m[r][0] << ", " << m[r][1] << ", " << m[r][2] << " ]\n";
+	}
+};
+
+typedef Fixed<16> Fixed16;
+
+typedef Vec3<double> Vector3Double;
+typedef Vec3<Fixed16> Vector3Fixed;
+
+typedef Mat3<float> Matrix3D;
+typedef Mat3<double> Matrix3Double;
+typedef Mat3<Fixed16> Matrix3Fixed;
+
+#endif /* VECTORMATH_H_ */
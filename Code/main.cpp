@@ -14,9 +14,20 @@
 #include "opencv2/video/tracking.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "Globals.h"
-#include "MorphOps.h"
+#include "SpotTracker.h"
+#include "PredictiveTracker.h"
+#include "SpotAssociator.h"
+#include "FramePipeline.h"
+#include "FrameCache.h"
+#include "FrameArena.h"
+#include "PixelKernels.h"
+#include "Centroid.h"
 #include "Geometry.h"
 #include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <csignal>
+#include <fstream>
 #include <vector>
 using std::vector;
 
@@ -46,41 +57,46 @@ VideoCapture videoCapture;
 const int VIDEO_WIDTH = 640;
 const int VIDEO_HEIGHT = 480;
 
-// Matrices to store frames
-Mat frame, nextFrame; // Raw frames from camera / image; nextFrame for motion tracking comparison
-Mat frameGray, nextFrameGray; // Gray frames for motion tracking
-Mat hsvFrame; // Matrix to store HSV colour conversion
-Mat thresholdFrame; // Matrix to store thresholded HSV image
-Mat differenceFrame; // Matrix to store pixel differences between two frames
-Mat differenceThresholdFrame; // Matrix to store thresholded difference image
+// Raw frames from camera / image; nextFrame for motion tracking comparison
+Mat frame, nextFrame;
 
-// Motion Thresholding Parameters
-int thresholdSensitivity = 40;
-int thresholdSensitivityMax = 255;
+// The tracking pipeline driven by the windows. It owns its own copies of the frames and its parameters.
+SpotTracker tracker;
+
+// Kalman filter tracking on top of 'tracker', which searches only around where each spot is expected once the spots are locked
+PredictiveTracker predictor( &tracker );
 
-// HSV Thresholding Parameters
-int hMin = 0, sMin = 0, vMin = 0;
-int hMax = 179, sMax = 255, vMax = 255;
+// Gives the spots found by 'tracker' identities that last from frame to frame when not tracking predictively
+SpotAssociator associator;
 
-// Morphological Operation Parameters
-int erodeSize = 3, erodeMax = 9;
-int dilateSize = 3, dilateMax = 9;
-int blurStrength = 0, blurMax = 20;
+// Decoded images, kept so that the same image is not read from disk on every loop
+FrameCache frameCache;
 
-// Tracking Parameters
-int numberOfObjects;
-int maxNumberOfObjects = 50;
-int objectAreaMin = 10 * 10;
-int objectAreaMax = (100 * 100);
+// Buffers each loop reads and draws into, sized from the first frame, and the count of what each loop allocates
+FrameArena arena;
+
+// Trackbar Limits
+int thresholdSensitivityMax = 255;
+int hueMax = 179, satMax = 255, valMax = 255;
+int erodeMax = 31, dilateMax = 31, blurMax = 41;
+int objectAreaLimit = 100 * 100;
 
 // Control Parameters
-bool blurFrame = true, erodeFrame = true, dilateFrame = true, trackFrame = true;
 bool videoTrack = false, imageTrack = true;
 bool colourTrack = false, differenceTrack = false;
 bool printCoordinates = false, showHSV = true;
+bool predictiveTrack = false;
+bool backgroundTrack = false;
+bool havePreviousFrame = false; // 'frame' holds the last video frame read, for predictive tracking of streamed video
+float detectionScale; // Scale frames are loaded at, or spots first found at when the frames are loaded at full size
 int mouseX, mouseY;
 
 int input = 0;
+volatile sig_atomic_t interrupted = 0; // Set by Ctrl-C while the threaded pipeline runs
+
+// Batch Processing Parameters
+const int batchChunkSize = 64; // Number of video frames decoded before being processed in parallel
+char defaultBatchOutputName[] = "spots.txt";
 
 
 // ================================= End Variables ================================= //
@@ -95,9 +111,19 @@ void setUpColourWindows();
 void setUpMainWindow();
 void setUpMotionWindows();
 void setOdd( int, void *);
-void trackThresholdPixels( Mat );
+void setFrameScale( TrackingParameters*, float );
+void updateFrameScale();
+void trackThresholdPixels( Mat* );
+bool readImage( const char*, Mat* );
+bool readVideoFrame( VideoCapture*, Mat* );
+void setPairingInterval( VideoCapture*, TrackingParameters* );
+void prefetchImages();
+void runBatchProcessing( char, const char*, const char* );
+void runPipelineTracking( char, const char*, bool );
 static void onMouse( int, int, int, int, void* );
-void printHSV();
+static void onInterrupt( int );
+static void listTrackerBuffers( vector<Mat*>* );
+void printHSV( Mat* );
 
 // ================================= End Function Declarations ================================= //
 
@@ -175,6 +201,29 @@ int main( int argc, char** argv)
 	char choice;
 	setUpImageNames();
 
+	/*
+	 * Headless usage: -batch <d|c> [video file] [output file]
+	 * 'd' tracks by difference and 'c' by colour. Without a video file every image set is processed.
+	 */
+	if ( argc > 2 && strcmp( argv[1], "-batch" ) == 0 )
+	{
+		runBatchProcessing( argv[2][0], argc > 3 ? argv[3] : NULL, argc > 4 ? argv[4] : defaultBatchOutputName );
+		return 0;
+	}
+
+	/*
+	 * Threaded usage: -pipeline <d|c> [video file] [-nodisplay]
+	 * Captures, tracks and displays on separate threads. Without a video file the webcam is used.
+	 */
+	if ( argc > 2 && strcmp( argv[1], "-pipeline" ) == 0 )
+	{
+		bool display = !( argc > 3 && strcmp( argv[argc - 1], "-nodisplay" ) == 0 );
+		const char *videoFileName = ( argc > 3 && strcmp( argv[3], "-nodisplay" ) != 0 ) ? argv[3] : NULL;
+
+		runPipelineTracking( argv[2][0], videoFileName, display );
+		return 0;
+	}
+
 	cout << "Track or Calculate: t or c\n";
 	cin >> choice;
 
@@ -217,6 +266,7 @@ void runTrackingAlgorithm()
 		videoCapture.open( 0 );
 		videoCapture.set( CV_CAP_PROP_FRAME_WIDTH, VIDEO_WIDTH );
 		videoCapture.set( CV_CAP_PROP_FRAME_HEIGHT, VIDEO_HEIGHT );
+		setPairingInterval( &videoCapture, &tracker.params );
 	}
 
 
@@ -239,6 +289,15 @@ void runTrackingAlgorithm()
 
 	input = waitKey(10);
 
+	detectionScale = tracker.params.frameScale;
+
+	if ( imageTrack ) prefetchImages();
+
+	// The frames read and every image the tracker keeps should be written into in place once they have been sized
+	arena.watch( &frame );
+	arena.watch( &nextFrame );
+	arena.watch( listTrackerBuffers );
+
 	// While escape key (code = 27) not pressed, wait 40ms each
 	while ( input != 27 )
 	{
@@ -269,89 +328,265 @@ void runTrackingAlgorithm()
 
 		// If r is pressed, toggle erode operations
 		if ( input == 114 )
-			erodeFrame = !erodeFrame;
+			tracker.params.erodeFrame = !tracker.params.erodeFrame;
 
 		// If t is pressed, toggle dilate operations
 		if ( input == 116 )
-			dilateFrame = !dilateFrame;
+			tracker.params.dilateFrame = !tracker.params.dilateFrame;
 
 		// If b is pressed, toggle blurring
 		if ( input == 98 )
-			blurFrame = !blurFrame;
+			tracker.params.blurFrame = !tracker.params.blurFrame;
 
 		// If m is pressed, toggle hsv indication
 		if ( input == 109 )
 			showHSV = !showHSV;
+
+		// If f is pressed, toggle the fused difference kernel
+		if ( input == 102 )
+			tracker.params.fusedDifference = !tracker.params.fusedDifference;
+
+		// If k is pressed, add the current HSV range as another colour class; x clears the colour classes
+		if ( input == 107 && (int)tracker.params.colourClasses.size() < ColourTable::maxClasses )
+		{
+			TrackingParameters *p = &tracker.params;
+			HSVRange range = { p->hMin, p->sMin, p->vMin, p->hMax, p->sMax, p->vMax };
+			p->colourClasses.push_back( range );
+			cout << "Colour classes: " << p->colourClasses.size() << endl;
+		}
+		if ( input == 120 )
+			tracker.params.colourClasses.clear();
+
+		// If g is pressed, toggle coarse to fine detection. Frames are then loaded at full size, spots are found at the usual frame
+		// scale and each one is measured in a full size window.
+		if ( input == 103 )
+		{
+			tracker.params.coarseToFine = !tracker.params.coarseToFine;
+			updateFrameScale();
+		}
+
+		// If n is pressed, toggle predictive tracking with Kalman filters
+		if ( input == 110 )
+		{
+			predictiveTrack = !predictiveTrack;
+			havePreviousFrame = false;
+			predictor.reset();
+			associator.reset();
+		}
+
+		// If j is pressed, cycle how streamed video frames are paired: sliding, by parity, then by timestamp
+		if ( input == 106 )
+		{
+			tracker.params.streamPairing = ( tracker.params.streamPairing + 1 ) % 3;
+			tracker.resetStream();
+			cout << "Stream pairing: " << ( tracker.params.streamPairing == PAIR_SLIDING ? "sliding" :
+			                                 tracker.params.streamPairing == PAIR_PARITY ? "parity" : "timestamp" ) << endl;
+		}
+
+		// If u is pressed, toggle comparing with a running average background instead of a reference frame
+		if ( input == 117 )
+		{
+			backgroundTrack = !backgroundTrack;
+			tracker.resetBackground();
+
+			if ( backgroundTrack && ( tracker.params.blockChanges || tracker.params.tiledPipeline ) )
+				cout << "Changed tiles and the tiled pipeline are not used when tracking by background" << endl;
+		}
+
+		// The background is updated at every pixel, so z and h below don't apply to it
+		if ( ( input == 122 || input == 104 ) && backgroundTrack )
+			cout << "Changed tiles and the tiled pipeline are not used when tracking by background" << endl;
+
+		// If z is pressed, toggle only tracking by difference in the tiles of the frame that have changed
+		if ( input == 122 && !backgroundTrack )
+			tracker.params.blockChanges = !tracker.params.blockChanges;
+
+		// If h is pressed, toggle tracking full size frames with the tiled pipeline, which uses every core
+		if ( input == 104 && !backgroundTrack )
+		{
+			tracker.params.tiledPipeline = !tracker.params.tiledPipeline;
+			updateFrameScale();
+		}
+
+		// If l is pressed, toggle the colour lookup table
+		if ( input == 108 )
+			tracker.params.lookupColour = !tracker.params.lookupColour;
+
+		// If v is pressed, check the fused difference kernel gives the same result as the separate steps
+		if ( input == 118 && differenceTrack )
+		{
+			bool same = checkDifferenceThreshold( tracker.frame, tracker.nextFrame, tracker.params.thresholdSensitivity );
+			cout << "Fused difference kernel " << ( same ? "matches" : "DOES NOT match" ) << " separate steps" << endl;
+		}
+
+		// If v is pressed, also check that the tiled pipeline finds the same spots as the whole frame in the current mode
+		if ( input == 118 && ( differenceTrack || colourTrack ) )
+		{
+			bool same = checkTiledPipeline( tracker.params, tracker.frame, differenceTrack ? tracker.nextFrame : Mat() );
+			cout << "Tiled pipeline " << ( same ? "matches" : "DOES NOT match" ) << " the single threaded pipeline" << endl;
+
+			long long allocations;
+			bool steady = checkSteadyTracking( tracker.params, tracker.frame, differenceTrack ? tracker.nextFrame : Mat(), &allocations );
+			cout << "Tracking again with blur, HSV and lookup colour " << ( steady ? "allocates nothing" : "DOES allocate" ) << ": "
+			     << allocations << " allocations" << endl;
+		}
+
+		// If v is pressed, also check the bit packed morphology against OpenCV and the subpixel centroids against synthetic spots
+		if ( input == 118 )
+		{
+			bool same = checkBitMorphology();
+			cout << "Bit packed morphology " << ( same ? "matches" : "DOES NOT match" ) << " erode and dilate" << endl;
+
+			float isolatedError, denseError;
+			bool isolated = checkCentroids( 0.125f, 100, &isolatedError ), dense = checkCentroids( 0.2f, 5, &denseError );
+			cout << "Subpixel centroids " << ( isolated && dense ? "are" : "are NOT" ) << " within tolerance: largest error "
+			     << isolatedError << " px alone, " << denseError << " px with a spot 5 px away" << endl;
+
+			long long steady = arena.steadyAllocations();
+			cout << "Loops since warming up " << ( steady == 0 ? "allocate nothing" : "DO allocate" ) << ": " << steady
+			     << " allocations" << endl;
+		}
+
+		// Any key can change what a loop needs, such as the image shown or the tracking mode, so let the buffers settle again
+		if ( input != -1 )
+			arena.restartWarmUp();
+
+		// Start loading the images around a new selection while the user looks at this one
+		if ( imageTrack && ( input == 119 || input == 115 || input == 97 || input == 100 ) )
+			prefetchImages();
 	}
 }
 
+/*
+ * Reads an image through the frame cache, scaled ready for the tracker. Returns false if the file could not be read.
+ */
+bool readImage( const char *fileName, Mat *dest )
+{
+	if ( !frameCache.get( fileName, tracker.params.frameScale, dest ) )
+		return false;
+
+	if ( !arena.sized ) arena.prepare( *dest );
+	return true;
+}
+
+/*
+ * Reads the next frame from 'capture' into 'dest', scaled ready for the tracker. The frame is captured into the arena, so once the
+ * first frame has sized it no new buffer is needed. Returns false if no frame could be read.
+ */
+bool readVideoFrame( VideoCapture *capture, Mat *dest )
+{
+	if ( !capture->read( arena.raw ) )
+		return false;
+
+	if ( !arena.sized ) arena.prepare( arena.raw );
+
+	resize( arena.raw, *dest, Size(), tracker.params.frameScale, tracker.params.frameScale );
+	return true;
+}
+
+/*
+ * Sets the longest time between the two frames of a pair from the frame rate of 'capture'. One and a half frame periods are allowed,
+ * so a frame that arrives a little late still pairs with the frame before it. The default is kept if the frame rate is not known.
+ */
+void setPairingInterval( VideoCapture *capture, TrackingParameters *p )
+{
+	double fps = capture->get( CV_CAP_PROP_FPS );
+
+	if ( fps > 0 )
+		p->pairingInterval = 1.5 * 1000 / fps;
+}
+
+/*
+ * Asks the frame cache to load, in the background, the images that can be reached from the current selection with one key press.
+ */
+void prefetchImages()
+{
+	float scale = tracker.params.frameScale;
+	int nextSet = ( imageSetIndex == imageSetIndexMax - 1 ? 0 : imageSetIndex + 1 );
+	int previousSet = ( imageSetIndex == 0 ? imageSetIndexMax - 1 : imageSetIndex - 1 );
+
+	// Reference image and neighbours within this set
+	frameCache.prefetch( imageNames[imageSetIndex][0], scale );
+	frameCache.prefetch( imageNames[imageSetIndex][imageIndex == imageIndexMax - 1 ? 0 : imageIndex + 1], scale );
+	frameCache.prefetch( imageNames[imageSetIndex][imageIndex == 0 ? imageIndexMax - 1 : imageIndex - 1], scale );
+
+	// Images shown after moving to the next or previous set
+	frameCache.prefetch( imageNames[nextSet][0], scale );
+	frameCache.prefetch( imageNames[nextSet][1], scale );
+	frameCache.prefetch( imageNames[previousSet][0], scale );
+	frameCache.prefetch( imageNames[previousSet][1], scale );
+}
+
 /*
  * This function will track light spots by looking for pixel differences between two images.
  */
 void trackByDifference()
 {
-	// If focus is to track by images, load image with error catching.
-	if ( imageTrack )
-	{
-		frame = imread( imageNames[imageSetIndex][0], CV_LOAD_IMAGE_COLOR );
-		if (frame.cols == 0) {
-		     cout << "Error reading file " << endl;
-		}
-		flip( frame, frame, 0 ); // Silly me took pictures upside down
-	}
-	else
-	{
-		videoCapture.read( frame );
-	}
+	arena.beginLoop();
 
-	// Read the next frame so we can compare the difference
-	// This assumes that enough time has passed so that the next frame has already been captured by the camera
-	if ( videoTrack )
+	// Compare each frame with a running average of the frames before it
+	if ( backgroundTrack && !predictiveTrack )
 	{
-		videoCapture.read( nextFrame );
-	}
-	else if ( imageTrack )
-	{
-		nextFrame = imread( imageNames[imageSetIndex][imageIndex], CV_LOAD_IMAGE_COLOR );
+		if ( videoTrack )
+			readVideoFrame( &videoCapture, &nextFrame );
+		else
+			readImage( imageNames[imageSetIndex][imageIndex], &nextFrame );
 
-		flip( nextFrame, nextFrame, 0 ); // Silly me took pictures upside down
+		tracker.trackByBackground( nextFrame );
+		associator.associate( &tracker.spots );
 	}
+	// Live video is streamed, so each frame read is compared with the one before it rather than reading two frames every loop
+	else if ( videoTrack && !predictiveTrack )
+	{
+		readVideoFrame( &videoCapture, &frame );
 
-	// Resize windows to fit on laptop screen
-	resize( frame, frame, Size(), 0.2f, 0.2f );
-	resize( nextFrame, nextFrame, frame.size() );
-
-
-	// Convert 'frame' to gray scale;
-	cvtColor( frame, frameGray, CV_RGB2GRAY );
-	// Convert the next frame to gray scale;
-	cvtColor( nextFrame, nextFrameGray, CV_RGB2GRAY );
+		double timestamp = videoCapture.get( CV_CAP_PROP_POS_MSEC );
+		if ( timestamp <= 0 ) timestamp = 1000.0 * getTickCount() / getTickFrequency();
 
-	// Get the absolute different between pixel values in the two images
-	absdiff( frameGray, nextFrameGray, differenceFrame );
+		// The first frame of a pair has nothing to be compared with yet
+		if ( !tracker.trackStreamFrame( frame, timestamp ) )
+		{
+			arena.endLoop();
+			return;
+		}
 
-	// Threshold the difference image out to get clearer motion
-	threshold( differenceFrame, differenceThresholdFrame, thresholdSensitivity, 255, THRESH_BINARY );
+		associator.associate( &tracker.spots );
+	}
+	// Predictive tracking of live video compares each frame with the one read before it, so it also reads one frame every loop
+	else if ( videoTrack )
+	{
+		if ( havePreviousFrame )
+			swap( frame, nextFrame );
+		else
+			havePreviousFrame = readVideoFrame( &videoCapture, &frame );
 
-	// Blur image to get rid of noise
-	if ( blurFrame && blurStrength != 0 )
-		blurImage( &differenceThresholdFrame, &differenceThresholdFrame, 1, blurStrength );
+		readVideoFrame( &videoCapture, &nextFrame );
+		predictor.trackByDifference( frame, nextFrame );
+	}
+	else
+	{
+		readImage( imageNames[imageSetIndex][0], &frame );
+		readImage( imageNames[imageSetIndex][imageIndex], &nextFrame );
 
-	// Erode and Dilate 'thresholdFrame' to get rid of noise
-	if ( erodeFrame && erodeSize != 0 )
-			erodeImage( &differenceThresholdFrame, &differenceThresholdFrame, 0, erodeSize );
+		if ( predictiveTrack )
+			predictor.trackByDifference( frame, nextFrame );
+		else
+		{
+			tracker.trackByDifference( frame, nextFrame );
+			associator.associate( &tracker.spots );
+		}
+	}
 
-	if ( dilateFrame && dilateSize != 0 )
-		dilateImage( &differenceThresholdFrame, &differenceThresholdFrame, 0, dilateSize );
+	arena.endLoop();
 
 	// Track object in real camera feed based on threshold pixels
-	if ( trackFrame )
-		trackThresholdPixels( differenceThresholdFrame );
+	if ( tracker.params.trackFrame )
+		trackThresholdPixels( &tracker.nextFrame );
 
 	// Show result
-	imshow( mainWindowName, nextFrame );
-	imshow( differenceWindowName, differenceFrame );
-	imshow( differenceThresholdWindowName, differenceThresholdFrame );
+	imshow( mainWindowName, tracker.nextFrame );
+	imshow( differenceWindowName, tracker.differenceFrame );
+	imshow( differenceThresholdWindowName, tracker.differenceThresholdFrame );
 }
 
 /*
@@ -359,52 +594,38 @@ void trackByDifference()
  */
 void trackByColour()
 {
+	arena.beginLoop();
+
 	// Read frame from 'videoCapture' and put into 'frame'
 	if ( videoTrack )
 	{
-		videoCapture.read( frame );
+		readVideoFrame( &videoCapture, &frame );
 	}
 	else if ( imageTrack )
 	{
-		frame = imread( imageNames[imageSetIndex][imageIndex], CV_LOAD_IMAGE_COLOR );
-		if (frame.cols == 0) {
-			cout << "Error reading file " << endl;
-		}
-
-		flip( frame, frame, 0 ); // Silly me took pictures upside down
+		readImage( imageNames[imageSetIndex][imageIndex], &frame );
 	}
 
-	// Pictures too big for my laptop screen...
-	resize( frame, frame, Size(), 0.2f, 0.2f );
-
-	// Convert 'frame' to HSV colour scheme and put into new Matrix 'hsvFrame'
-	cvtColor( frame, hsvFrame, CV_BGR2HSV );
-
-	// Find pixels from a specific colour range from 'hsvFrame', set those to one and all others to
-	// zero, and put result in new Matrix 'thresholdFrame'
-	inRange( hsvFrame, Scalar(hMin, sMin, vMin), Scalar(hMax, sMax, vMax), thresholdFrame );
-
-	// Blur image to get rid of noise
-	if ( blurFrame && blurStrength != 0 )
-		blurImage( &thresholdFrame, &thresholdFrame, 1, blurStrength );
-
-	// Erode and Dilate 'thresholdFrame' to get rid of noise
-	if ( erodeFrame && erodeSize != 0 )
-			erodeImage( &thresholdFrame, &thresholdFrame, 0, erodeSize );
+	if ( predictiveTrack )
+		predictor.trackByColour( frame );
+	else
+	{
+		tracker.trackByColour( frame );
+		associator.associate( &tracker.spots );
+	}
 
-	if ( dilateFrame && dilateSize != 0 )
-		dilateImage( &thresholdFrame, &thresholdFrame, 0, dilateSize );
+	arena.endLoop();
 
 	// Track object in real camera feed based on threshold pixels
-	if ( trackFrame )
-		trackThresholdPixels( thresholdFrame );
+	if ( tracker.params.trackFrame )
+		trackThresholdPixels( &tracker.frame );
 
-	// Show result
-	imshow( mainWindowName, frame );
-	imshow( hsvWindowName, hsvFrame );
-	imshow( thresholdWindowName, thresholdFrame );
+	if ( showHSV ) printHSV( &tracker.frame );
 
-	if ( showHSV ) printHSV();
+	// Show result
+	imshow( mainWindowName, tracker.frame );
+	imshow( hsvWindowName, tracker.hsvFrame );
+	imshow( thresholdWindowName, tracker.thresholdFrame );
 }
 
 /*
@@ -419,16 +640,16 @@ void setUpColourWindows()
 	namedWindow( trackbarWindowName );
 
 	// Add Trackbars
-	createTrackbar( "Hue Min", trackbarWindowName, &hMin, hMax );
-	createTrackbar( "Hue Max", trackbarWindowName, &hMax, hMax );
-	createTrackbar( "Sat Min", trackbarWindowName, &sMin, sMax );
-	createTrackbar( "Sat Max", trackbarWindowName, &sMax, sMax );
-	createTrackbar( "Val Min", trackbarWindowName, &vMin, vMax );
-	createTrackbar( "Val Max", trackbarWindowName, &vMax, vMax );
+	createTrackbar( "Hue Min", trackbarWindowName, &tracker.params.hMin, hueMax );
+	createTrackbar( "Hue Max", trackbarWindowName, &tracker.params.hMax, hueMax );
+	createTrackbar( "Sat Min", trackbarWindowName, &tracker.params.sMin, satMax );
+	createTrackbar( "Sat Max", trackbarWindowName, &tracker.params.sMax, satMax );
+	createTrackbar( "Val Min", trackbarWindowName, &tracker.params.vMin, valMax );
+	createTrackbar( "Val Max", trackbarWindowName, &tracker.params.vMax, valMax );
 
-	createTrackbar( "Erode Size", trackbarWindowName, &erodeSize, erodeMax, setOdd );
-	createTrackbar( "Dilate Size", trackbarWindowName, &dilateSize, dilateMax, setOdd );
-	createTrackbar( "Blur Strength", trackbarWindowName, &blurStrength, blurMax, setOdd );
+	createTrackbar( "Erode Size", trackbarWindowName, &tracker.params.erodeSize, erodeMax, setOdd );
+	createTrackbar( "Dilate Size", trackbarWindowName, &tracker.params.dilateSize, dilateMax, setOdd );
+	createTrackbar( "Blur Strength", trackbarWindowName, &tracker.params.blurStrength, blurMax, setOdd );
 
 	setMouseCallback( mainWindowName, onMouse, 0 );
 }
@@ -442,9 +663,9 @@ void setUpMainWindow()
 	namedWindow( mainWindowName );
 
 	// Add tracking trackbars
-	createTrackbar( "Max Number of Objects", mainWindowName, &maxNumberOfObjects, 200 );
-	createTrackbar( "Min Object Area", mainWindowName, &objectAreaMin, objectAreaMax );
-	createTrackbar( "Max Object Area", mainWindowName, &objectAreaMax, objectAreaMax );
+	createTrackbar( "Max Number of Objects", mainWindowName, &tracker.params.maxNumberOfObjects, 200 );
+	createTrackbar( "Min Object Area", mainWindowName, &tracker.params.objectAreaMin, objectAreaLimit );
+	createTrackbar( "Max Object Area", mainWindowName, &tracker.params.objectAreaMax, objectAreaLimit );
 }
 
 /*
@@ -459,64 +680,43 @@ void setUpMotionWindows()
 	namedWindow( differenceThresholdWindowName );
 
 	// Add Trackbars
-	createTrackbar( "Erode Size", trackbarWindowName, &erodeSize, erodeMax, setOdd );
-	createTrackbar( "Dilate Size", trackbarWindowName, &dilateSize, dilateMax, setOdd );
-	createTrackbar( "Blur Strength", trackbarWindowName, &blurStrength, blurMax, setOdd );
-	createTrackbar( "Sensitivity", trackbarWindowName, &thresholdSensitivity, thresholdSensitivityMax );
+	createTrackbar( "Erode Size", trackbarWindowName, &tracker.params.erodeSize, erodeMax, setOdd );
+	createTrackbar( "Dilate Size", trackbarWindowName, &tracker.params.dilateSize, dilateMax, setOdd );
+	createTrackbar( "Blur Strength", trackbarWindowName, &tracker.params.blurStrength, blurMax, setOdd );
+	createTrackbar( "Sensitivity", trackbarWindowName, &tracker.params.thresholdSensitivity, thresholdSensitivityMax );
 }
 
 /*
- * Function to track the thresholded pixels ( all set to 1 ) in a given Matrix
+ * Function to mark the spots found by the tracker on a given Matrix, and print their coordinates if requested
  */
-void trackThresholdPixels( Mat threshFrame )
+void trackThresholdPixels( Mat *image )
 {
-	int x, y;
-	int objectsWithinSize;
-	Mat temp;
-	vector< vector<Point> > contours;
-	vector<Vec4i> contourHierarchy;
+	tracker.drawSpots( image );
 
-	threshFrame.copyTo( temp );
-
-	// Get contours of pixels set to one in thresholded image.
-	findContours( temp, contours, contourHierarchy, CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE );
-
-	numberOfObjects = contourHierarchy.size();
-	objectsWithinSize = 0;
-
-	if ( printCoordinates ) cout << "---- Spot Coordinates ----" << endl;
-
-	// Assuming that the only objects left in 'thresholdFrame' are what we want, track them all.
-	if ( numberOfObjects > 0 && numberOfObjects < maxNumberOfObjects )
+	if ( printCoordinates )
 	{
-		for ( int index = 0; index >= 0; index = contourHierarchy[index][0] )
-		{
-			// Get area from contour object
-			Moments moment = moments((cv::Mat)contours[index]);
-			double area = moment.m00;
-
-			if ( area > objectAreaMin )
-			{
-				// Circle spot on screen
-				x = moment.m10/area;
-				y = moment.m01/area;
-
-				if ( colourTrack ) circle( frame, Point(x,y), 10, Scalar(0,255,0), 2);
-				if ( differenceTrack ) circle( nextFrame, Point(x,y), 10, Scalar(0,255,0), 2);
+		cout << "---- Spot Coordinates ----" << endl;
 
-				objectsWithinSize++;
+		for ( size_t i = 0; i < tracker.spots.size(); i++ )
+		{
+			cout << "\t";
+			if ( tracker.spots[i].id >= 0 ) cout << "#" << tracker.spots[i].id << "\t";
+			cout << tracker.spots[i].centre.x << ", " << tracker.spots[i].centre.y;
+			if ( tracker.spots[i].uncertainty > 0 ) cout << "\t(+/- " << tracker.spots[i].uncertainty << ")";
+			if ( tracker.spots[i].colourClass >= 0 ) cout << "\t(colour " << tracker.spots[i].colourClass << ")";
+			cout << "\n";
+		}
 
-				if ( printCoordinates ) cout << "\t" << intToString( x ) << ", " << intToString( y ) << "\n";
-			}
+		if ( predictiveTrack )
+		{
+			cout << "Tracks: " << predictor.tracks.size() << "\tPixels searched: " << predictor.pixelsProcessed << " of "
+			     << tracker.frame.total() << ( predictor.fullPass ? " (full pass)" : "" ) << endl;
 		}
 
-		// Display how many objects are being tracked
-		if ( colourTrack ) putText( frame, "Spots Found: " + intToString( objectsWithinSize ), Point(10,20), 1, 1, Scalar(0,255,0), 2);
-		if ( differenceTrack ) putText( nextFrame, "Spots Found: " + intToString( objectsWithinSize ), Point(10,20), 1, 1, Scalar(0,255,0), 2);
+		cout << "Allocations: " << arena.loopAllocations() << " last loop, " << arena.steadyAllocations() << " since warming up" << endl;
 
+		printCoordinates = !printCoordinates;
 	}
-
-	if ( printCoordinates ) printCoordinates = !printCoordinates;
 }
 
 /*
@@ -526,45 +726,71 @@ void setOdd( int val, void *)
 {
 	if ( val != 0 )
 	{
-		if ( !(erodeSize % 2 == 1) )
+		TrackingParameters *p = &tracker.params;
+
+		if ( !(p->erodeSize % 2 == 1) )
 		{
-			erodeSize = ( erodeSize > 1 ? erodeSize - 1 : 1 );
+			p->erodeSize = ( p->erodeSize > 1 ? p->erodeSize - 1 : 1 );
 		}
 
-		if ( !(dilateSize % 2 == 1) )
+		if ( !(p->dilateSize % 2 == 1) )
 		{
-			dilateSize = ( dilateSize > 1 ? dilateSize - 1 : 1 );
+			p->dilateSize = ( p->dilateSize > 1 ? p->dilateSize - 1 : 1 );
 		}
 
-		if ( !(blurStrength % 2 == 1) )
+		if ( !(p->blurStrength % 2 == 1) )
 		{
-			blurStrength = ( blurStrength > 1 ? blurStrength - 1 : 1 );
+			p->blurStrength = ( p->blurStrength > 1 ? p->blurStrength - 1 : 1 );
 		}
 	}
 }
 
 /*
- *  Function that is called on mouse click that will print out the hsv value of the pixel at the mouse position.
+ * Changes the scale frames are loaded at to 'scale'. Object areas and kernel sizes are in pixels of the frame given to the tracker,
+ * so they are resized with it and find the same spots at any scale. Kernel sizes are kept odd.
  */
-void printHSV()
+void setFrameScale( TrackingParameters *p, float scale )
 {
-	Mat image;
+	float ratio = scale / p->frameScale;
+	p->frameScale = scale;
 
-	if ( colourTrack ) image = frame.clone();
-	if ( differenceTrack ) image = nextFrame.clone();
+	p->objectAreaMin = cvRound( p->objectAreaMin * ratio * ratio );
+	p->objectAreaMax = cvRound( p->objectAreaMax * ratio * ratio );
 
+	if ( p->erodeSize != 0 ) p->erodeSize = cvRound( p->erodeSize * ratio ) | 1;
+	if ( p->dilateSize != 0 ) p->dilateSize = cvRound( p->dilateSize * ratio ) | 1;
+	if ( p->blurStrength != 0 ) p->blurStrength = cvRound( p->blurStrength * ratio ) | 1;
+}
+
+/*
+ * Sets the tracker's frame scale from the modes that are on. Coarse to fine detection and the tiled pipeline both want full size
+ * frames, and coarse to fine then finds spots at the detection scale, so the detection scale is kept whichever is turned off first.
+ */
+void updateFrameScale()
+{
+	TrackingParameters *p = &tracker.params;
+
+	p->coarseScale = detectionScale;
+	setFrameScale( p, ( p->coarseToFine || p->tiledPipeline ) ? 1 : detectionScale );
+}
+
+/*
+ *  Function that is called on mouse click that will print out the hsv value of the pixel at the mouse position. The values are drawn
+ *  straight onto 'image', which is about to be shown, and the pixel is converted in the arena, so the frame is never copied.
+ */
+void printHSV( Mat *image )
+{
 	// Get RGB Values
-	Vec3b rgb = image.at<Vec3b>(mouseY, mouseX);
+	Vec3b rgb = image->at<Vec3b>(mouseY, mouseX);
 	int B=rgb.val[0];
 	int G=rgb.val[1];
 	int R=rgb.val[2];
 
-	Mat HSV;
-	Mat RGB = image( Rect(mouseX, mouseY, 1, 1) );
-	cvtColor( RGB, HSV, CV_BGR2HSV );
+	arena.pixel.at<Vec3b>(0,0) = rgb;
+	cvtColor( arena.pixel, arena.pixelHSV, CV_BGR2HSV );
 
 	// Get HSV Values
-	Vec3b hsv = HSV.at<Vec3b>(0,0);
+	Vec3b hsv = arena.pixelHSV.at<Vec3b>(0,0);
 	int H = hsv.val[0];
 	int S = hsv.val[1];
 	int V = hsv.val[2];
@@ -572,24 +798,22 @@ void printHSV()
 	// Put text on screen (on top of image)
 	char name[30];
 	sprintf(name,"B=%d",B);
-	putText( image, name, Point(150,40), FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
+	putText( *image, name, Point(150,40), FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
 
 	sprintf(name,"G=%d",G);
-	putText( image,name, Point(150,80) , FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
+	putText( *image,name, Point(150,80) , FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
 
 	sprintf(name,"R=%d",R);
-	putText( image,name, Point(150,120) , FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
+	putText( *image,name, Point(150,120) , FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
 
 	sprintf(name,"H=%d",H);
-	putText( image,name, Point(25,40) , FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
+	putText( *image,name, Point(25,40) , FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
 
 	sprintf(name,"S=%d",S);
-	putText( image,name, Point(25,80) , FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
+	putText( *image,name, Point(25,80) , FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
 
 	sprintf(name,"V=%d",V);
-	putText( image,name, Point(25,120) , FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
-
-	imshow( mainWindowName, image );
+	putText( *image,name, Point(25,120) , FONT_HERSHEY_SIMPLEX, .7, Scalar(0,255,0) );
 }
 
 /*
@@ -607,3 +831,278 @@ static void onMouse( int event, int x, int y, int f, void* )
 
 
 
+
+
+// ================================= Batch Processing ================================= //
+
+/*
+ * A single unit of work for the batch processor: one frame (or pair of frames for difference tracking) and the spots found in it.
+ * Frames are either loaded from 'firstName' / 'secondName' while processing, or already read into 'first' / 'second'.
+ */
+struct BatchJob
+{
+	int set, index; // Image set and image index, or -1 and the frame number for a video
+	const char *firstName, *secondName;
+	Mat first, second;
+	vector<Spot> spots;
+};
+
+/*
+ * Runs a single batch job through 'tracker', without using any windows. Images are read through 'cache', so an image shared by
+ * several jobs is only decoded once; video frames are scaled here.
+ */
+void processBatchJob( BatchJob *job, SpotTracker *tracker, FrameCache *cache, char mode )
+{
+	float scale = tracker->params.frameScale;
+
+	if ( job->firstName != NULL && !cache->get( job->firstName, scale, &job->first ) ) return;
+	if ( job->firstName == NULL ) resize( job->first, job->first, Size(), scale, scale );
+
+	if ( mode == 'd' )
+	{
+		if ( job->secondName != NULL && !cache->get( job->secondName, scale, &job->second ) ) return;
+		if ( job->secondName == NULL ) resize( job->second, job->second, Size(), scale, scale );
+		tracker->trackByDifference( job->first, job->second );
+	}
+	else
+	{
+		tracker->trackByColour( job->first );
+	}
+
+	job->spots = tracker->spots;
+
+	// Frames are no longer needed once the spots are known
+	job->first.release();
+	job->second.release();
+}
+
+/*
+ * Loop body used to spread independent batch jobs across every core. Each range of jobs gets its own tracker, so no buffers are
+ * shared between threads.
+ */
+class BatchBody : public ParallelLoopBody
+{
+public:
+	BatchBody( vector<BatchJob> *jobs, const TrackingParameters &params, FrameCache *cache, char mode )
+		: jobs( jobs ), params( params ), cache( cache ), mode( mode ) { }
+
+	void operator()( const Range &range ) const
+	{
+		SpotTracker rangeTracker( params );
+
+		for ( int i = range.start; i < range.end; i++ )
+			processBatchJob( &(*jobs)[i], &rangeTracker, cache, mode );
+	}
+
+private:
+	vector<BatchJob> *jobs;
+	TrackingParameters params;
+	FrameCache *cache;
+	char mode;
+};
+
+/*
+ * Writes the spots found by a set of batch jobs to 'output', one spot per line, after giving them identities with 'spotAssociator'.
+ * The jobs must be in frame order.
+ */
+void writeBatchResults( vector<BatchJob> &jobs, SpotAssociator *spotAssociator, std::ofstream &output )
+{
+	for ( size_t i = 0; i < jobs.size(); i++ )
+	{
+		// Identities carry on from frame to frame within an image set or video, so start again at each new set
+		if ( i > 0 && jobs[i].set != jobs[i - 1].set )
+			spotAssociator->reset();
+
+		spotAssociator->associate( &jobs[i].spots );
+
+		for ( size_t j = 0; j < jobs[i].spots.size(); j++ )
+		{
+			const Spot &spot = jobs[i].spots[j];
+			output << jobs[i].set << "\t" << jobs[i].index << "\t" << spot.centre.x << "\t" << spot.centre.y << "\t" << spot.colourClass
+			       << "\t" << spot.id << "\n";
+		}
+	}
+}
+
+/*
+ * Pushes every image set, or every frame of a video file, through the tracking chain without any windows or key polling, and writes
+ * the spots found to 'outputFileName'. Mode 'd' tracks by difference and 'c' tracks by colour. Independent frames are processed on
+ * all cores at once; video frames are read in chunks of 'batchChunkSize' frames (pairs of frames when tracking by difference).
+ */
+void runBatchProcessing( char mode, const char *videoFileName, const char *outputFileName )
+{
+	vector<BatchJob> jobs;
+	FrameCache cache;
+	SpotAssociator spotAssociator;
+	int framesProcessed = 0;
+	int64 startTime = getTickCount();
+
+	if ( mode != 'd' && mode != 'c' )
+	{
+		cout << "Usage: -batch <d|c> [video file] [output file]" << endl;
+		return;
+	}
+
+	std::ofstream output( outputFileName );
+	if ( !output.is_open() )
+	{
+		cout << "Error opening file " << outputFileName << endl;
+		return;
+	}
+	output << "# set\tindex\tx\ty\tclass\tid\n";
+
+	// Nothing is displayed, so don't keep images that are only needed for windows
+	TrackingParameters params = tracker.params;
+	params.debugFrames = false;
+
+	if ( videoFileName == NULL )
+	{
+		// Difference tracking compares every image in a set against the first one, colour tracking looks at every image
+		for ( int set = 0; set < imageSetIndexMax; set++ )
+		{
+			for ( int index = ( mode == 'd' ? 1 : 0 ); index < imageIndexMax; index++ )
+			{
+				BatchJob job;
+				job.set = set;
+				job.index = index;
+				job.firstName = ( mode == 'd' ? imageNames[set][0] : imageNames[set][index] );
+				job.secondName = ( mode == 'd' ? imageNames[set][index] : NULL );
+				jobs.push_back( job );
+			}
+		}
+
+		parallel_for_( Range( 0, jobs.size() ), BatchBody( &jobs, params, &cache, mode ) );
+		writeBatchResults( jobs, &spotAssociator, output );
+		framesProcessed = jobs.size();
+	}
+	else
+	{
+		VideoCapture video( videoFileName );
+		bool framesLeft = true;
+
+		if ( !video.isOpened() )
+		{
+			cout << "Error reading file " << videoFileName << endl;
+			return;
+		}
+
+		while ( framesLeft )
+		{
+			jobs.clear();
+
+			// Decoding is sequential, so read a chunk of frames before processing them all at once
+			while ( (int)jobs.size() < batchChunkSize )
+			{
+				BatchJob job;
+				job.set = -1;
+				job.index = framesProcessed + jobs.size();
+				job.firstName = NULL;
+				job.secondName = NULL;
+
+				if ( !video.read( job.first ) || ( mode == 'd' && !video.read( job.second ) ) )
+				{
+					framesLeft = false;
+					break;
+				}
+
+				jobs.push_back( job );
+			}
+
+			parallel_for_( Range( 0, jobs.size() ), BatchBody( &jobs, params, &cache, mode ) );
+			writeBatchResults( jobs, &spotAssociator, output );
+			framesProcessed += jobs.size();
+		}
+	}
+
+	cout << "Processed " << framesProcessed << " frames in " << ( getTickCount() - startTime ) / getTickFrequency() << "s" << endl;
+}
+
+/*
+ * Tracks spots in a video file, or the webcam if 'videoFileName' is NULL, with capture, tracking and display each on their own
+ * thread. 'mode' is 'd' to track by difference and 'c' by colour. The webcam drops frames so results are always of the newest
+ * frame; a file is processed frame by frame. Escape, or Ctrl-C when nothing is displayed, stops early, and the counts and latencies
+ * are printed at the end.
+ */
+void runPipelineTracking( char mode, const char *videoFileName, bool display )
+{
+	VideoCapture capture;
+
+	if ( mode != 'd' && mode != 'c' )
+	{
+		cout << "Usage: -pipeline <d|c> [video file] [-nodisplay]" << endl;
+		return;
+	}
+
+	if ( videoFileName )
+		capture.open( videoFileName );
+	else
+	{
+		capture.open( 0 );
+		capture.set( CV_CAP_PROP_FRAME_WIDTH, VIDEO_WIDTH );
+		capture.set( CV_CAP_PROP_FRAME_HEIGHT, VIDEO_HEIGHT );
+	}
+
+	if ( !capture.isOpened() )
+	{
+		cout << "Error opening " << ( videoFileName ? videoFileName : "webcam" ) << endl;
+		return;
+	}
+
+	// Only the marked up frame is displayed, so don't keep the intermediate images
+	TrackingParameters params = tracker.params;
+	params.debugFrames = false;
+	setPairingInterval( &capture, &params );
+	SpotTracker pipelineTracker( params );
+
+	FramePipeline pipeline( &capture, &pipelineTracker, mode, videoFileName ? DROP_BLOCK : DROP_LATEST_WINS, display );
+
+	if ( display ) namedWindow( mainWindowName );
+	else cout << "Press Ctrl-C to stop" << endl;
+
+	interrupted = 0;
+	std::signal( SIGINT, onInterrupt );
+	pipeline.start();
+
+	while ( !pipeline.finished() && !interrupted )
+	{
+		if ( display )
+		{
+			PipelineFrame *result = pipeline.nextDisplayFrame();
+
+			if ( result )
+			{
+				imshow( mainWindowName, result->image );
+				pipeline.doneDisplaying();
+			}
+
+			if ( waitKey( 1 ) == 27 ) break;
+		}
+		else
+			std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+	}
+
+	pipeline.stop();
+	std::signal( SIGINT, SIG_DFL );
+
+	PipelineStats stats = pipeline.stats();
+	cout << "Captured " << stats.captured << ", processed " << stats.processed << ", displayed " << stats.displayed
+	     << ", dropped " << stats.dropped << endl;
+	cout << "Capture to result latency: last " << stats.lastLatency << "ms, mean " << stats.meanLatency << "ms, max "
+	     << stats.maxLatency << "ms" << endl;
+}
+
+/*
+ * Called on Ctrl-C while the threaded pipeline runs, so that it stops cleanly and prints its counts
+ */
+static void onInterrupt( int )
+{
+	interrupted = 1;
+}
+
+/*
+ * Lists the images kept by the tracker driven by the windows, for the arena to watch
+ */
+static void listTrackerBuffers( vector<Mat*> *buffers )
+{
+	tracker.listBuffers( buffers );
+}